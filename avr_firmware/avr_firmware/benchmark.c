@@ -0,0 +1,479 @@
+/*
+ * benchmark.c
+ *
+ * Created: 2026-10-17
+ */
+
+// Only built in the Benchmark configuration, where it replaces the real main.
+// Timer 3 runs at clk/1 so TCNT3 counts CPU cycles directly. This gives the same numbers on hardware, in the Studio simulator
+// and in simavr. Results are printed on USART1 as CSV lines: name,runs,min,max,mean (cycles).
+// A line starting with # is a comment. "done" marks the end of the run, or "failed" if anything went over its cycle budget.
+// The host build doesn't model interrupt flags or cycle timing, so this is AVR only.
+#if defined(BENCHMARK) && !defined(HOST_BUILD)
+
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "hal.h"
+#include "spi.h"
+#include "uart.h"
+#include "motor.h"
+#include "control_tick.h"
+#include "circular_buffer.h"
+#include "flexion.h"
+#include "calibration.h"
+#include "kinematics.h"
+#include "repetition.h"
+#include "resistance_curve.h"
+#include "motor_ramp.h"
+#include "soft_timer.h"
+
+// Bump this if the line format or the benchmark names change, so scripts comparing builds can tell
+#define BENCHMARK_FORMAT_VERSION 10
+
+#define BENCHMARK_RUNS 32
+
+typedef struct
+{
+	uint16_t min;
+	uint16_t max;
+	uint32_t total;
+	uint8_t runs;
+} bench_stats_t;
+
+void setup_gpio(void);
+
+static adc_readings_t current_readings;
+static joint_angles_t joint_angles;
+static finger_pose_t finger_poses[MOTOR_COUNT];
+static flexion_t flexion[MOTOR_COUNT];
+
+// Cost of the measurement itself, subtracted from every result
+static uint16_t call_overhead;
+static uint16_t window_overhead;
+
+// Benchmarks over their budget so far, which fails the run
+static uint8_t budget_failures;
+
+static inline uint16_t cycles_now(void)
+{
+	return TCNT3;
+}
+
+static void stats_reset(bench_stats_t *stats)
+{
+	stats->min = UINT16_MAX;
+	stats->max = 0;
+	stats->total = 0;
+	stats->runs = 0;
+}
+
+static void stats_add(bench_stats_t *stats, uint16_t cycles, uint16_t overhead)
+{
+	cycles = cycles > overhead ? cycles - overhead : 0;
+	if (cycles < stats->min) stats->min = cycles;
+	if (cycles > stats->max) stats->max = cycles;
+	stats->total += cycles;
+	stats->runs++;
+}
+
+// Blocks until the whole line is queued, so no result is ever dropped
+static void report_line(char *line)
+{
+	while (debug_send(line))
+	{
+		hal_idle();
+	}
+}
+
+static void report(const char *name, bench_stats_t *stats)
+{
+	char line[48];
+	if (stats->runs == 0)
+	{
+		stats->min = 0;
+	}
+	snprintf(line, sizeof(line), "%s,%u,%u,%u,%lu\n", name, stats->runs, stats->min, stats->max,
+		stats->runs ? (unsigned long)(stats->total / stats->runs) : 0UL);
+	report_line(line);
+}
+
+// Times a function called through a pointer. The cost of an empty call is subtracted.
+// Returns the worst case, for checking against a budget.
+static uint16_t bench_call(const char *name, void (*fn)(void))
+{
+	bench_stats_t stats;
+	stats_reset(&stats);
+	for (uint8_t i = 0; i < BENCHMARK_RUNS; i++)
+	{
+		uint16_t start = cycles_now();
+		fn();
+		stats_add(&stats, cycles_now() - start, call_overhead);
+	}
+	report(name, &stats);
+	return stats.max;
+}
+
+// Like bench_call(), but the worst case has to be within a budget the firmware depends on
+static void bench_budget(const char *name, void (*fn)(void), uint16_t budget)
+{
+	uint16_t cycles = bench_call(name, fn);
+	if (cycles > budget)
+	{
+		char line[64];
+		snprintf(line, sizeof(line), "# %s over budget, %u > %u\n", name, cycles, budget);
+		report_line(line);
+		budget_failures++;
+	}
+}
+
+// With interrupts off and an interrupt flag already set, sei followed by one instruction lets exactly one ISR run before cli.
+// AVR always executes one more instruction after sei and after reti before taking another interrupt.
+static uint16_t interrupt_window(void)
+{
+	uint16_t start = cycles_now();
+	sei();
+	__asm__ __volatile__ ("nop");
+	cli();
+	return cycles_now() - start;
+}
+
+static void empty_call(void)
+{
+}
+
+static void bench_polled_scan(void)
+{
+	for (potentiometer pot = 0; pot < POT_COUNT; pot++)
+	{
+		read_pot(pot, &current_readings);
+	}
+	for (motor m = 0; m < MOTOR_COUNT; m++)
+	{
+		read_motor(m, &current_readings);
+	}
+}
+
+static void bench_scan_all(void)
+{
+	scan_all(&current_readings);
+}
+
+static void bench_isr_scan(void)
+{
+	start_adc_scan(false);
+	while (adc_scan_busy());
+}
+
+static void bench_get_latest_readings(void)
+{
+	get_latest_readings(&current_readings);
+}
+
+static void bench_angles(void)
+{
+	readings_to_angles(&current_readings, &joint_angles);
+}
+
+static void bench_kinematics(void)
+{
+	update_kinematics(&joint_angles, finger_poses);
+}
+
+static void bench_flexion(void)
+{
+	update_flexion(finger_poses, flexion);
+}
+
+// Every motor counts as driven so the resisted time is added up too. The timestamp doesn't matter for the cost.
+static void bench_repetitions(void)
+{
+	update_repetitions(finger_poses, (1<<MOTOR_COUNT) - 1, 0);
+}
+
+// Full curves are set up in main, so every lookup searches all the way to the last segment
+static void bench_resistance_curves(void)
+{
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		uint16_t setpoint;
+		evaluate_resistance_curve(i, 7 * RES_CURVE_MIN_STEP * 2 - 1, &setpoint);
+	}
+}
+
+// Fills a circular buffer and empties it again, through either the copying calls or the spans. The indices start at a
+// different offset every run so most transfers wrap around the end of the array. Prints the throughput after the cycles.
+static void bench_circ_buf(const char *name, bool spans)
+{
+	static circular_buffer_t buf;
+	char data[BUF_SIZE];
+	bench_stats_t stats;
+	stats_reset(&stats);
+	memset(data, 0x55, sizeof(data));
+	circ_buf_init(&buf);
+	for (uint8_t i = 0; i < BENCHMARK_RUNS; i++)
+	{
+		circ_buf_commit_write(&buf, 13);
+		circ_buf_consume(&buf, 13);
+
+		uint16_t start = cycles_now();
+		if (spans)
+		{
+			char *span;
+			size_t len;
+			while ((len = circ_buf_get_write_span(&buf, &span)) > 0)
+			{
+				memcpy(span, data, len);
+				circ_buf_commit_write(&buf, len);
+			}
+			while ((len = circ_buf_get_read_span(&buf, &span)) > 0)
+			{
+				memcpy(data, span, len);
+				circ_buf_consume(&buf, len);
+			}
+		}
+		else
+		{
+			circ_buf_write_len(&buf, data, BUF_SIZE);
+			circ_buf_read(&buf, data, BUF_SIZE);
+		}
+		stats_add(&stats, cycles_now() - start, 0);
+	}
+	report(name, &stats);
+
+	// Every run moves BUF_SIZE bytes in and the same bytes out
+	char line[48];
+	uint32_t mean = stats.total / stats.runs;
+	snprintf(line, sizeof(line), "# %s %lu bytes per 1000 cycles\n", name, mean ? 2000UL * BUF_SIZE / mean : 0UL);
+	report_line(line);
+}
+
+static void bench_tick_overruns(void)
+{
+	get_tick_overruns();
+}
+
+// Waits for the previous frame to go out so every run sees the same empty buffer
+static void wait_send_empty(void)
+{
+	while (bt_get_send_free() < BUF_SIZE)
+	{
+		hal_idle();
+	}
+}
+
+static void bench_telemetry(const char *name, bool compressed)
+{
+	bench_stats_t stats;
+	stats_reset(&stats);
+	bt_set_compressed_telemetry(compressed);
+	for (uint8_t i = 0; i < BENCHMARK_RUNS; i++)
+	{
+		// Nudge one channel so the delta frames aren't all empty
+		current_readings.potentiometers[i % POT_COUNT] += (i & 1) ? 3 : -3;
+		wait_send_empty();
+		uint16_t start = cycles_now();
+		bt_send_telemetry(&current_readings);
+		stats_add(&stats, cycles_now() - start, 0);
+	}
+	report(name, &stats);
+}
+
+// Each SPI1 transfer complete interrupt of a scan, measured one at a time
+static void bench_isr_spi1(void)
+{
+	bench_stats_t stats;
+	stats_reset(&stats);
+	for (uint8_t i = 0; i < BENCHMARK_RUNS / 8; i++)
+	{
+		cli();
+		start_adc_scan(false);
+		while (adc_scan_busy())
+		{
+			while (!(SPSR1 & (1<<SPIF1)));
+			stats_add(&stats, interrupt_window(), window_overhead);
+		}
+		sei();
+	}
+	report("isr_spi1_stc", &stats);
+}
+
+static void bench_isr_udre(const char *name, uart_link link)
+{
+	bench_stats_t stats;
+	stats_reset(&stats);
+	uart_set_stream_link(UART_STREAM_DEBUG, link);
+	for (uint8_t i = 0; i < BENCHMARK_RUNS; i++)
+	{
+		// Wait for room in the data register so the flag is set and the ISR really sends the byte
+		if (link == UART_LINK_BT)
+		{
+			while (!(UCSR0A & (1<<UDRE0)));
+		}
+		else
+		{
+			while (!(UCSR1A & (1<<UDRE1)));
+		}
+		cli();
+		debug_send("U");
+		stats_add(&stats, interrupt_window(), window_overhead);
+		sei();
+	}
+	uart_set_stream_link(UART_STREAM_DEBUG, UART_LINK_DEBUG);
+	report(name, &stats);
+}
+
+static void bench_isr_tick(void)
+{
+	bench_stats_t stats;
+	stats_reset(&stats);
+	for (uint8_t i = 0; i < BENCHMARK_RUNS; i++)
+	{
+		cli();
+		while (!(TIFR4 & (1<<OCF4A)));
+		stats_add(&stats, interrupt_window(), window_overhead);
+		sei();
+		wait_for_control_tick();
+	}
+	report("isr_timer4_compa", &stats);
+}
+
+// The soft timer tick with the motor ramp timer running, which is the only periodic timer
+static void bench_isr_tc3_compa(void)
+{
+	bench_stats_t stats;
+	stats_reset(&stats);
+	setup_soft_timers();
+	setup_motor_ramps();
+	for (uint8_t i = 0; i < BENCHMARK_RUNS; i++)
+	{
+		cli();
+		while (!(TIFR3 & (1<<OCF3A)));
+		stats_add(&stats, interrupt_window(), window_overhead);
+		sei();
+	}
+	TIMSK3 = 0;
+	report("isr_timer3_compa", &stats);
+}
+
+// One control iteration's worth of work, minus the motor output, and the tick period it runs under
+static void bench_loop(void)
+{
+	bench_stats_t work;
+	bench_stats_t period;
+	stats_reset(&work);
+	stats_reset(&period);
+	bt_set_compressed_telemetry(true);
+
+	// A 1kHz tick is 8000 cycles, which fits in TCNT3 without overflowing
+	setup_control_tick(CONTROL_TICK_MAX_HZ);
+	start_adc_scan(false);
+	wait_for_control_tick();
+	uint16_t last_tick = cycles_now();
+	for (uint8_t i = 0; i < BENCHMARK_RUNS; i++)
+	{
+		wait_for_control_tick();
+		uint16_t start = cycles_now();
+		stats_add(&period, start - last_tick, 0);
+		last_tick = start;
+
+		get_latest_readings(&current_readings);
+		start_adc_scan(false);
+		set_tick_phase(TICK_PHASE_FILTER);
+		readings_to_angles(&current_readings, &joint_angles);
+		update_kinematics(&joint_angles, finger_poses);
+		set_tick_phase(TICK_PHASE_DECIDE);
+		update_flexion(finger_poses, flexion);
+		update_repetitions(finger_poses, 0, 0);
+		uart_tick();
+		set_tick_phase(TICK_PHASE_REPORT);
+		if (bt_get_send_free() >= BT_SNAPSHOT_FRAME_LEN)
+		{
+			bt_send_telemetry(&current_readings);
+		}
+		stats_add(&work, cycles_now() - start, 0);
+	}
+	setup_control_tick(CONTROL_TICK_HZ);
+	report("loop_work", &work);
+	report("loop_period", &period);
+}
+
+int main(void)
+{
+	setup_gpio();
+	setup_spi();
+	setup_uart();
+	setup_motors();
+	setup_control_tick(CONTROL_TICK_HZ);
+
+	// Free running at clk/1, no interrupt. This is the cycle counter.
+	TCCR3A = 0;
+	TCCR3B = (1<<CS30);
+	TIMSK3 = 0;
+
+	memset(&current_readings, 0, sizeof(adc_readings_t));
+	load_calibration();
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		for (uint8_t k = 0; k < RES_CURVE_MAX_POINTS; k++)
+		{
+			curve_point_t point = { k * RES_CURVE_MIN_STEP * 2, k * 100 };
+			stage_curve_point(i, k, &point);
+		}
+		apply_staged_curve(i, RES_CURVE_MAX_POINTS);
+	}
+
+	// Calibrate the measurement overhead with interrupts off so nothing can land in the middle
+	uint16_t start = cycles_now();
+	empty_call();
+	call_overhead = cycles_now() - start;
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		start = cycles_now();
+		empty_call();
+		uint16_t cycles = cycles_now() - start;
+		if (cycles < call_overhead) call_overhead = cycles;
+	}
+	window_overhead = interrupt_window();
+
+	sei();
+
+	char line[48];
+	snprintf(line, sizeof(line), "# glove benchmark v%u, %lu Hz\n", BENCHMARK_FORMAT_VERSION, (unsigned long)F_CPU);
+	report_line(line);
+	snprintf(line, sizeof(line), "# spi1 clock F_CPU/%u\n", calibrate_spi_clock());
+	report_line(line);
+	report_line("name,runs,min,max,mean\n");
+
+	bench_call("adc_scan_polled", bench_polled_scan);
+	bench_call("adc_scan_all", bench_scan_all);
+	bench_call("adc_scan_isr", bench_isr_scan);
+	bench_call("get_latest_readings", bench_get_latest_readings);
+	// The angle conversion is two precomputed linear segments per pot rather than a lookup table, so show its cost per pot
+	snprintf(line, sizeof(line), "# readings_to_angles %u cycles per pot\n", bench_call("readings_to_angles", bench_angles) / POT_COUNT);
+	report_line(line);
+	bench_budget("update_kinematics", bench_kinematics, KINEMATICS_CYCLE_BUDGET);
+	bench_call("update_flexion", bench_flexion);
+	bench_call("update_repetitions", bench_repetitions);
+	bench_budget("resistance_curves", bench_resistance_curves, RES_CURVE_CYCLE_BUDGET);
+	bench_circ_buf("circ_buf_copy", false);
+	bench_circ_buf("circ_buf_spans", true);
+	bench_call("atomic_tick_overruns", bench_tick_overruns);
+	bench_telemetry("telemetry_snapshot", false);
+	bench_telemetry("telemetry_delta", true);
+	bench_isr_spi1();
+	bench_isr_udre("isr_usart0_udre", UART_LINK_BT);
+	bench_isr_udre("isr_usart1_udre", UART_LINK_DEBUG);
+	bench_isr_tick();
+	bench_isr_tc3_compa();
+	bench_loop();
+
+	report_line(budget_failures ? "failed\n" : "done\n");
+	while (1)
+	{
+		hal_idle();
+	}
+}
+
+#endif
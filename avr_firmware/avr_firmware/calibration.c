@@ -0,0 +1,230 @@
+/*
+ * calibration.c
+ *
+ * Created: 2026-10-17
+ */
+
+#include "calibration.h"
+
+#include <stddef.h>
+
+#include "hal.h"
+
+// Bump this if pot_calibration_t or calibration_record_t change, so an old record isn't read as a new one
+#define CALIBRATION_VERSION 1
+
+// Angle at a pot's midpoint
+#define CAL_ANGLE_HALF ((CAL_ANGLE_MAX + 1) / 2)
+
+// Raw counts, without the filter's fractional bits
+typedef struct
+{
+	uint16_t min;
+	uint16_t mid;
+	uint16_t max;
+} pot_calibration_t;
+
+typedef struct
+{
+	uint8_t version;
+	pot_calibration_t pots[POT_COUNT];
+	uint16_t crc;					// CRC-CCITT of everything above
+} calibration_record_t;
+
+// Precomputed conversion of one pot. Angles are measured down from the top of the range, since the pots read lower as a finger flexes.
+typedef struct
+{
+	int16_t top;					// Reading at angle 0
+	int16_t mid;					// Reading at CAL_ANGLE_HALF
+	uint16_t upper_gain;			// Angle per count between top and mid, with 8 fractional bits
+	uint16_t lower_gain;			// Angle per count below mid, with 8 fractional bits
+} angle_map_t;
+
+static calibration_record_t EEMEM stored_calibration;
+
+static angle_map_t angle_maps[POT_COUNT];
+static bool valid;
+
+// Ranges being recorded
+static pot_calibration_t recording[POT_COUNT];
+static bool recording_active;
+static bool midpoints_captured;
+static bool midpoint_capture_pending;
+
+static uint16_t record_crc(const calibration_record_t *record)
+{
+	uint16_t crc = 0xFFFF;
+	const uint8_t *bytes = (const uint8_t*)record;
+	for (size_t i = 0; i < offsetof(calibration_record_t, crc); i++)
+	{
+		crc = _crc_ccitt_update(crc, bytes[i]);
+	}
+	return crc;
+}
+
+static void build_angle_map(angle_map_t *map, const pot_calibration_t *pot)
+{
+	map->top = (int16_t)pot->max << POT_FILTER_SHIFT;
+	map->mid = (int16_t)pot->mid << POT_FILTER_SHIFT;
+	// Each side spans at least CAL_MIN_SPAN / 2 counts, so the gains stay below 16 bits
+	map->upper_gain = ((uint32_t)CAL_ANGLE_HALF << 8) / (pot->max - pot->mid);
+	map->lower_gain = ((uint32_t)CAL_ANGLE_HALF << 8) / (pot->mid - pot->min);
+}
+
+static void build_default_maps(void)
+{
+	pot_calibration_t full_range = { 0, CAL_ANGLE_HALF - 1, CAL_ANGLE_MAX };
+	for (uint8_t i = 0; i < POT_COUNT; i++)
+	{
+		build_angle_map(&angle_maps[i], &full_range);
+	}
+}
+
+int load_calibration(void)
+{
+	calibration_record_t record;
+	eeprom_read_block(&record, &stored_calibration, sizeof(record));
+	valid = record.version == CALIBRATION_VERSION && record.crc == record_crc(&record);
+	if (!valid)
+	{
+		build_default_maps();
+		return 1;
+	}
+
+	for (uint8_t i = 0; i < POT_COUNT; i++)
+	{
+		build_angle_map(&angle_maps[i], &record.pots[i]);
+	}
+	return 0;
+}
+
+bool calibration_valid(void)
+{
+	return valid;
+}
+
+void start_calibration(void)
+{
+	for (uint8_t i = 0; i < POT_COUNT; i++)
+	{
+		recording[i].min = UINT16_MAX;
+		recording[i].max = 0;
+	}
+	midpoints_captured = false;
+	midpoint_capture_pending = false;
+	recording_active = true;
+}
+
+void cancel_calibration(void)
+{
+	recording_active = false;
+}
+
+bool calibration_recording(void)
+{
+	return recording_active;
+}
+
+int capture_calibration_midpoints(void)
+{
+	if (!recording_active)
+	{
+		return 1;
+	}
+
+	midpoint_capture_pending = true;
+	return 0;
+}
+
+void record_calibration(const adc_readings_t *readings)
+{
+	if (!recording_active)
+	{
+		return;
+	}
+
+	for (uint8_t i = 0; i < POT_COUNT; i++)
+	{
+		uint16_t raw = readings->potentiometers[i] >> POT_FILTER_SHIFT;
+		if (raw < recording[i].min)
+		{
+			recording[i].min = raw;
+		}
+		if (raw > recording[i].max)
+		{
+			recording[i].max = raw;
+		}
+		if (midpoint_capture_pending)
+		{
+			recording[i].mid = raw;
+		}
+	}
+
+	if (midpoint_capture_pending)
+	{
+		midpoint_capture_pending = false;
+		midpoints_captured = true;
+	}
+}
+
+int save_calibration(void)
+{
+	if (!recording_active)
+	{
+		return 1;
+	}
+
+	calibration_record_t record;
+	record.version = CALIBRATION_VERSION;
+	for (uint8_t i = 0; i < POT_COUNT; i++)
+	{
+		pot_calibration_t *pot = &record.pots[i];
+		*pot = recording[i];
+		if (pot->min > pot->max || pot->max - pot->min < CAL_MIN_SPAN)
+		{
+			return 1;
+		}
+
+		// A midpoint too close to either end would make that side's gain overflow, so fall back to the middle of the range
+		if (!midpoints_captured || pot->mid < pot->min + CAL_MIN_SPAN / 2 || pot->mid > pot->max - CAL_MIN_SPAN / 2)
+		{
+			pot->mid = (pot->min + pot->max) / 2;
+		}
+	}
+	record.crc = record_crc(&record);
+
+	eeprom_update_block(&record, &stored_calibration, sizeof(record));
+	for (uint8_t i = 0; i < POT_COUNT; i++)
+	{
+		build_angle_map(&angle_maps[i], &record.pots[i]);
+	}
+	valid = true;
+	recording_active = false;
+	return 0;
+}
+
+void readings_to_angles(const adc_readings_t *readings, joint_angles_t *dest)
+{
+	for (uint8_t i = 0; i < POT_COUNT; i++)
+	{
+		const angle_map_t *map = &angle_maps[i];
+		int16_t reading = readings->potentiometers[i];
+		uint16_t angle;
+		if (reading >= map->top)
+		{
+			angle = 0;
+		}
+		else if (reading >= map->mid)
+		{
+			// Both factors fit in 16 bits, so this compiles to a 16x16 bit multiply rather than a full 32 bit one
+			angle = ((uint32_t)(uint16_t)(map->top - reading) * map->upper_gain) >> 8;
+		}
+		else
+		{
+			// Readings below the calibrated range would overflow 16 bits before being clamped
+			uint32_t below = (CAL_ANGLE_HALF << POT_FILTER_SHIFT) + (((uint32_t)(uint16_t)(map->mid - reading) * map->lower_gain) >> 8);
+			angle = below > (CAL_ANGLE_MAX << POT_FILTER_SHIFT) ? (CAL_ANGLE_MAX << POT_FILTER_SHIFT) : (uint16_t)below;
+		}
+		dest->joints[i] = (int16_t)angle;
+	}
+}
@@ -0,0 +1,104 @@
+/*
+ * calibration.h
+ *
+ * Created: 2026-10-17
+ */
+
+
+#ifndef CALIBRATION_H_
+#define CALIBRATION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "spi.h"
+
+// Full scale of a normalized joint angle. 0 is the straightest position seen during calibration, CAL_ANGLE_MAX the most flexed.
+#define CAL_ANGLE_MAX 1023
+
+// Smallest range of raw counts a pot has to move through during calibration to be accepted
+#define CAL_MIN_SPAN 32
+
+// Joint angles of every pot, from 0 to CAL_ANGLE_MAX with POT_FILTER_SHIFT fractional bits like the readings they come from.
+// Angles rise as a finger flexes.
+typedef struct
+{
+	int16_t joints[POT_COUNT];
+} joint_angles_t;
+
+/**
+ * \brief Loads the calibration from EEPROM and builds the angle conversion table. Without a valid calibration every pot
+ * maps its full 0 to 1023 range straight onto the angle, so angles are the raw counts reversed.
+ *
+ * \return int 0 if a valid calibration was loaded. Nonzero indicates the EEPROM was blank or failed its CRC and the defaults are in use.
+ */
+int load_calibration(void);
+
+/**
+ * \brief Checks if the angle conversion comes from a stored calibration rather than the defaults.
+ *
+ * \return bool True if a calibration has been loaded or saved.
+ */
+bool calibration_valid(void);
+
+/**
+ * \brief Starts recording the range of every pot. Move every joint through its full range, then call save_calibration().
+ *
+ * \return void
+ */
+void start_calibration(void);
+
+/**
+ * \brief Stops recording without changing the stored calibration.
+ *
+ * \return void
+ */
+void cancel_calibration(void);
+
+/**
+ * \brief Checks if a calibration is being recorded.
+ *
+ * \return bool True between start_calibration() and save_calibration() or cancel_calibration().
+ */
+bool calibration_recording(void);
+
+/**
+ * \brief Records the current position of every pot as its midpoint, which maps to half of CAL_ANGLE_MAX. Taken from the next
+ * call to record_calibration(). Without midpoints the range is mapped linearly.
+ *
+ * \return int 0 if the operation was successful. Nonzero indicates no calibration is being recorded.
+ */
+int capture_calibration_midpoints(void);
+
+/**
+ * \brief Widens each pot's recorded range to include a scan. Call with every new scan while recording. Does nothing otherwise.
+ *
+ * \param readings The filtered readings of the scan.
+ *
+ * \return void
+ */
+void record_calibration(const adc_readings_t *readings);
+
+/**
+ * \brief Stops recording, stores the recorded ranges in EEPROM with a CRC and starts using them. Blocks while the EEPROM is
+ * written, up to 0.3s.
+ *
+ * \return int 0 if the operation was successful. Nonzero indicates no calibration was being recorded or a pot moved through
+ * less than CAL_MIN_SPAN counts, in which case nothing is stored and recording continues.
+ */
+int save_calibration(void);
+
+/**
+ * \brief Converts the pot readings of a scan to joint angles. One 16x16 bit multiply per pot, no division.
+ * N.B. This isn't a lookup table: one entry per reading for every pot would take 28KB of RAM, and the chip has 2KB.
+ * Instead each pot's two linear segments are precomputed as gains when the calibration loads. The benchmark prints the
+ * cost per pot after the readings_to_angles row.
+ *
+ * \param readings The filtered readings to convert.
+ * \param dest The angles to fill in.
+ *
+ * \return void
+ */
+void readings_to_angles(const adc_readings_t *readings, joint_angles_t *dest);
+
+#endif /* CALIBRATION_H_ */
@@ -9,53 +9,103 @@
 
 #include <string.h>
 
+#if BUF_SIZE > 128 || (BUF_SIZE & (BUF_SIZE - 1)) != 0
+#error "BUF_SIZE must be a power of 2 no larger than 128"
+#endif
+
+// Stops the compiler from moving the span copies across the index loads and stores that guard them.
+// The indices are volatile but the span contents are accessed through plain pointers.
+#define COMPILER_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
 void circ_buf_init(volatile circular_buffer_t *buf)
 {
 	buf->read_idx = 0;
 	buf->write_idx = 0;
 }
 
-void circ_buf_write_str(volatile circular_buffer_t *buf, char* data)
+size_t circ_buf_write_str(volatile circular_buffer_t *buf, char* data)
 {
-	circ_buf_write_len(buf, data, strlen(data));
+	return circ_buf_write_len(buf, data, strlen(data));
 }
 
-void circ_buf_write_len(volatile circular_buffer_t *buf, char* data, size_t len)
+size_t circ_buf_write_len(volatile circular_buffer_t *buf, char* data, size_t len)
 {
-	for (size_t i = 0; i < len; i++)
+	size_t written = 0;
+	// At most two spans: up to the end of the array, then from the start after wrapping around
+	while (written < len)
 	{
-		// Write from the data input to the buffer, and wrap the write index back around to 0 if it reaches BUF_SIZE.
-		buf->buffer[buf->write_idx] = data[i];
-		// Since BUF_SIZE is power of 2, BUF_SIZE - 1 is all 1s in binary.
-		// Therefore when write_idx reaches BUF_SIZE, the AND operation results in 0. In any other case, the value is unchanged.
-		// This is way faster than doing modulo of an arbitrary number.
-		buf->write_idx = (buf->write_idx + 1) & (BUF_SIZE - 1);
+		char *span;
+		size_t span_len = circ_buf_get_write_span(buf, &span);
+		if (span_len == 0) break;
+		if (span_len > len - written) span_len = len - written;
+		
+		memcpy(span, data + written, span_len);
+		circ_buf_commit_write(buf, span_len);
+		written += span_len;
 	}
+	return written;
 }
 
 size_t circ_buf_read(volatile circular_buffer_t *buf, char* out, size_t out_len)
 {
-	for (size_t i = 0; i < out_len; i++)
+	size_t read = 0;
+	while (read < out_len)
 	{
+		char *span;
+		size_t span_len = circ_buf_get_read_span(buf, &span);
 		// Return immediately if there's nothing left to read
-		if (circ_buf_get_len(buf) == 0) return i;
+		if (span_len == 0) break;
+		if (span_len > out_len - read) span_len = out_len - read;
 		
-		// Copy a byte out of the buffer and increment, wrapping around if necessary
-		out[i] = buf->buffer[buf->read_idx];
-		buf->read_idx = (buf->read_idx + 1) & (BUF_SIZE - 1);
+		memcpy(out + read, span, span_len);
+		circ_buf_consume(buf, span_len);
+		read += span_len;
 	}
-	return out_len;
+	return read;
 }
 
 size_t circ_buf_get_len(volatile circular_buffer_t *buf)
 {
-	// Current length of the circular buffer is equivalent to (write - read) mod BUF_SIZE
-	if (buf->write_idx >= buf->read_idx)
-	{
-		return buf->write_idx - buf->read_idx;
-	}
-	else
-	{
-		return BUF_SIZE + buf->write_idx - buf->read_idx;
-	}
+	// The indices are free-running, so the 8 bit difference is the length even after either one wraps around
+	return (uint8_t)(buf->write_idx - buf->read_idx);
+}
+
+size_t circ_buf_get_free(volatile circular_buffer_t *buf)
+{
+	return BUF_SIZE - circ_buf_get_len(buf);
+}
+
+size_t circ_buf_get_write_span(volatile circular_buffer_t *buf, char **span)
+{
+	// Since BUF_SIZE is power of 2, BUF_SIZE - 1 is all 1s in binary, so the AND gives the position in the array.
+	uint8_t pos = buf->write_idx & (BUF_SIZE - 1);
+	size_t free = circ_buf_get_free(buf);
+	size_t to_end = BUF_SIZE - pos;
+	
+	*span = (char*)&buf->buffer[pos];
+	COMPILER_BARRIER();
+	return free < to_end ? free : to_end;
+}
+
+void circ_buf_commit_write(volatile circular_buffer_t *buf, size_t len)
+{
+	COMPILER_BARRIER();
+	buf->write_idx += (uint8_t)len;
+}
+
+size_t circ_buf_get_read_span(volatile circular_buffer_t *buf, char **span)
+{
+	uint8_t pos = buf->read_idx & (BUF_SIZE - 1);
+	size_t len = circ_buf_get_len(buf);
+	size_t to_end = BUF_SIZE - pos;
+	
+	*span = (char*)&buf->buffer[pos];
+	COMPILER_BARRIER();
+	return len < to_end ? len : to_end;
+}
+
+void circ_buf_consume(volatile circular_buffer_t *buf, size_t len)
+{
+	COMPILER_BARRIER();
+	buf->read_idx += (uint8_t)len;
 }
@@ -10,16 +10,23 @@
 #define CIRCULAR_BUFFER_H_
 
 #include <stdlib.h>
+#include <stdint.h>
 
 // This value must be a power of 2 so that the modulus operation is fast when we wrap around.
+// It must also be at most 128, since the indices are free-running 8 bit counters (see below).
 #define BUF_SIZE 64
 
 // Defines a circular buffer used to send and receive data from the UARTs.
+// The buffer is a single-producer/single-consumer queue: exactly one context (main loop or ISR) may write and exactly one may read.
+// The producer only ever modifies write_idx and the consumer only ever modifies read_idx. Both are 8 bits wide so they are loaded and stored atomically on AVR,
+// which means neither side needs to disable interrupts.
+// The indices count up freely and wrap at 256; they are masked with BUF_SIZE - 1 only when accessing the array.
+// This way write_idx - read_idx is always the number of bytes stored, and the full BUF_SIZE bytes can be used.
 typedef struct circular_buffer
 {
 	char buffer[BUF_SIZE];
-	size_t read_idx;
-	size_t write_idx;
+	uint8_t read_idx;
+	uint8_t write_idx;
 } circular_buffer_t;
 
 /**
@@ -32,28 +39,28 @@ typedef struct circular_buffer
 void circ_buf_init(volatile circular_buffer_t *buf);
 
 /**
- * \brief Writes data into a circular buffer. Does not perform bounds checking; old data may be overwritten.
+ * \brief Writes data into a circular buffer. Producer side only. Stops early if the buffer fills up; unread data is never overwritten.
  * 
  * \param buf A pointer to the buffer to write into.
  * \param data A null-terminated string of data to write.
  * 
- * \return void
+ * \return size_t The number of bytes that were actually written.
  */
-void circ_buf_write_str(volatile circular_buffer_t *buf, char* data);
+size_t circ_buf_write_str(volatile circular_buffer_t *buf, char* data);
 
 /**
- * \brief Writes data into a circular buffer. Does not perform bounds checking; old data may be overwritten.
+ * \brief Writes data into a circular buffer. Producer side only. Stops early if the buffer fills up; unread data is never overwritten.
  * 
  * \param buf A pointer to the buffer to write into.
  * \param data A buffer of data to write.
  * \param len The number of bytes to write.
  * 
- * \return void
+ * \return size_t The number of bytes that were actually written.
  */
-void circ_buf_write_len(volatile circular_buffer_t *buf, char* data, size_t len);
+size_t circ_buf_write_len(volatile circular_buffer_t *buf, char* data, size_t len);
 
 /**
- * \brief Reads up to a given number of characters from a circular buffer. Returns early if there is no more data to read.
+ * \brief Reads up to a given number of characters from a circular buffer. Consumer side only. Returns early if there is no more data to read.
  * 
  * \param buf The buffer to read from.
  * \param out An array to copy the read bytes into.
@@ -72,4 +79,55 @@ size_t circ_buf_read(volatile circular_buffer_t *buf, char* out, size_t out_len)
  */
 size_t circ_buf_get_len(volatile circular_buffer_t *buf);
 
-#endif /* CIRCULAR_BUFFER_H_ */
\ No newline at end of file
+/**
+ * \brief Returns the amount of space in the buffer that can be written.
+ * 
+ * \param buf The buffer to check.
+ * 
+ * \return size_t The number of bytes that can be written without overwriting unread data.
+ */
+size_t circ_buf_get_free(volatile circular_buffer_t *buf);
+
+/**
+ * \brief Gets the largest contiguous run of free space starting at the write position. Producer side only.
+ * Fill some or all of the span, then publish it with circ_buf_commit_write(). A second call may be needed after wrapping around the end of the array.
+ * 
+ * \param buf The buffer to write into.
+ * \param span Set to the start of the writable run.
+ * 
+ * \return size_t The length of the writable run. 0 if the buffer is full.
+ */
+size_t circ_buf_get_write_span(volatile circular_buffer_t *buf, char **span);
+
+/**
+ * \brief Publishes bytes written into a span from circ_buf_get_write_span() to the consumer. Producer side only.
+ * 
+ * \param buf The buffer that was written into.
+ * \param len The number of bytes written, no more than the span length.
+ * 
+ * \return void
+ */
+void circ_buf_commit_write(volatile circular_buffer_t *buf, size_t len);
+
+/**
+ * \brief Gets the largest contiguous run of unread data starting at the read position. Consumer side only.
+ * Use some or all of the span, then release it with circ_buf_consume(). A second call may be needed after wrapping around the end of the array.
+ * 
+ * \param buf The buffer to read from.
+ * \param span Set to the start of the readable run.
+ * 
+ * \return size_t The length of the readable run. 0 if the buffer is empty.
+ */
+size_t circ_buf_get_read_span(volatile circular_buffer_t *buf, char **span);
+
+/**
+ * \brief Releases bytes read from a span from circ_buf_get_read_span() back to the producer. Consumer side only.
+ * 
+ * \param buf The buffer that was read from.
+ * \param len The number of bytes read, no more than the span length.
+ * 
+ * \return void
+ */
+void circ_buf_consume(volatile circular_buffer_t *buf, size_t len);
+
+#endif /* CIRCULAR_BUFFER_H_ */
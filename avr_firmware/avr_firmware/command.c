@@ -0,0 +1,83 @@
+/*
+ * command.c
+ *
+ * Created: 2026-10-17
+ */ 
+
+#include "command.h"
+
+void command_parser_init(command_parser_t* parser, const command_t* table, uint8_t table_len)
+{
+	parser->table = table;
+	parser->table_len = table_len;
+	parser->synced = false;
+	parser->pending = NULL;
+	parser->arg_count = 0;
+	parser->last_ms = 0;
+}
+
+static const command_t* find_command(command_parser_t* parser, uint8_t opcode)
+{
+	for (uint8_t i = 0; i < parser->table_len; i++)
+	{
+		if (parser->table[i].opcode == opcode)
+		{
+			return &parser->table[i];
+		}
+	}
+	return NULL;
+}
+
+void command_parser_feed(command_parser_t* parser, const char* data, size_t len, uint16_t now_ms)
+{
+	if (len == 0) return;
+	
+	// Drop whatever was half received if the rest took too long, it's from a command the app has given up on
+	if ((uint16_t)(now_ms - parser->last_ms) > CMD_BYTE_TIMEOUT_MS)
+	{
+		parser->synced = false;
+		parser->pending = NULL;
+	}
+	parser->last_ms = now_ms;
+	
+	for (size_t i = 0; i < len; i++)
+	{
+		uint8_t byte = (uint8_t)data[i];
+		
+		if (parser->pending == NULL)
+		{
+			if (!parser->synced)
+			{
+				// Skip anything between commands
+				parser->synced = byte == CMD_SYNC;
+				continue;
+			}
+			
+			parser->pending = find_command(parser, byte);
+			parser->arg_count = 0;
+			parser->checksum = byte;
+			// An unknown opcode means we synced on a stray byte. A repeated sync byte could still be the real start.
+			parser->synced = parser->pending == NULL && byte == CMD_SYNC;
+		}
+		else if (parser->arg_count < parser->pending->arg_len)
+		{
+			parser->args[parser->arg_count++] = byte;
+			parser->checksum ^= byte;
+		}
+		else
+		{
+			// Clear the pending command first in case the handler feeds the parser again
+			const command_t* cmd = parser->pending;
+			parser->pending = NULL;
+			if (byte == parser->checksum)
+			{
+				cmd->handler(parser->args);
+			}
+			else
+			{
+				// A byte went missing, so this one may be the start of the next command
+				parser->synced = byte == CMD_SYNC;
+			}
+		}
+	}
+}
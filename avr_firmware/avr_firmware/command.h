@@ -0,0 +1,74 @@
+/*
+ * command.h
+ *
+ * Created: 2026-10-17
+ */ 
+
+
+#ifndef COMMAND_H_
+#define COMMAND_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Largest number of argument bytes any command can carry
+#define CMD_MAX_ARGS 8
+
+// Every command starts with this byte. No opcode may use it.
+#define CMD_SYNC 0x7E
+
+// A command that stops arriving for longer than this is dropped, so a stale partial command can't swallow the start of the next one
+#define CMD_BYTE_TIMEOUT_MS 100
+
+typedef void (*command_handler)(const uint8_t* args);
+
+// One entry in a command table. On the wire every command is CMD_SYNC, the opcode, a fixed number of argument bytes,
+// then the XOR of the opcode and the arguments. So 0x01 with no arguments is sent as 7E 01 01.
+// The checksum means a lost or corrupted byte drops the command instead of running argument bytes as opcodes.
+typedef struct command
+{
+	uint8_t opcode;
+	uint8_t arg_len;
+	command_handler handler;
+} command_t;
+
+// Incremental decoder state. Holds on to a partially received command between calls to command_parser_feed().
+typedef struct command_parser
+{
+	const command_t* table;
+	uint8_t table_len;
+	bool synced;					// Got CMD_SYNC, the opcode is next
+	const command_t* pending;		// Opcode received, waiting for the arguments and checksum
+	uint8_t arg_count;
+	uint8_t checksum;
+	uint16_t last_ms;				// When the last bytes were fed
+	uint8_t args[CMD_MAX_ARGS];
+} command_parser_t;
+
+/**
+ * \brief Initializes a command parser. Should be called before doing anything else with the object.
+ * 
+ * \param parser The parser to initialize.
+ * \param table The commands to recognize. Every arg_len must be at most CMD_MAX_ARGS.
+ * \param table_len The number of entries in table.
+ * 
+ * \return void
+ */
+void command_parser_init(command_parser_t* parser, const command_t* table, uint8_t table_len);
+
+/**
+ * \brief Feeds received bytes into the parser, calling the handler of every command that is completed with a good checksum.
+ * A command split across calls is completed on a later call, unless more than CMD_BYTE_TIMEOUT_MS pass between them.
+ * Anything outside a command, an unknown opcode, or a command with a bad checksum is discarded and the parser waits for the next CMD_SYNC.
+ * 
+ * \param parser The parser to feed.
+ * \param data The received bytes.
+ * \param len The number of bytes in data.
+ * \param now_ms Timestamp from timer_now(). Bytes are timed when they're fed, so feed them at least every few ms.
+ * 
+ * \return void
+ */
+void command_parser_feed(command_parser_t* parser, const char* data, size_t len, uint16_t now_ms);
+
+#endif /* COMMAND_H_ */
@@ -0,0 +1,121 @@
+/*
+ * control_tick.c
+ *
+ * Created: 2026-10-17
+ */ 
+
+#include "control_tick.h"
+
+#include <stdbool.h>
+
+#include "hal.h"
+#include "profiler.h"
+
+// TC4 runs at F_CPU / 8 = 1 MHz, so the compare value is simply 1000000 / rate - 1.
+#define TICK_TIMER_HZ 1000000UL
+
+static volatile bool tick_pending;
+static volatile tick_phase current_phase;
+static volatile uint16_t overruns;
+static volatile uint16_t phase_overruns[TICK_PHASE_COUNT];
+static uint16_t tick_rate_hz = CONTROL_TICK_HZ;
+
+// Profiler timestamps for the start of the current phase and of the current iteration
+static uint32_t phase_start;
+static uint32_t loop_start;
+
+int setup_control_tick(uint16_t rate_hz)
+{
+	if (rate_hz < CONTROL_TICK_MIN_HZ || rate_hz > CONTROL_TICK_MAX_HZ)
+	{
+		return 1;
+	}
+	
+	tick_pending = false;
+	current_phase = TICK_PHASE_IDLE;
+	
+	// CTC mode with OCR4A as top, prescaler 8
+	TCCR4A = 0;
+	TCCR4B = (1<<WGM42) | (1<<CS41);
+	TCNT4 = 0;
+	OCR4A = (uint16_t)(TICK_TIMER_HZ / rate_hz - 1);
+	// Compare match A interrupt enabled
+	TIMSK4 = (1<<OCIE4A);
+	tick_rate_hz = rate_hz;
+	
+	return 0;
+}
+
+uint16_t get_control_tick_rate(void)
+{
+	return tick_rate_hz;
+}
+
+void wait_for_control_tick(void)
+{
+	// Phases share their numbering with the profiler slots. Nothing is recorded for the first call, which isn't the end of an iteration.
+	if (current_phase != TICK_PHASE_IDLE)
+	{
+		profile_record((profile_slot)current_phase, phase_start);
+		profile_record(PROFILE_LOOP, loop_start);
+	}
+	current_phase = TICK_PHASE_IDLE;
+	while (!tick_pending)
+	{
+		hal_idle();
+	}
+	tick_pending = false;
+	current_phase = TICK_PHASE_ACQUIRE;
+	phase_start = profile_now();
+	loop_start = phase_start;
+}
+
+void set_tick_phase(tick_phase phase)
+{
+	if (current_phase != TICK_PHASE_IDLE)
+	{
+		profile_record((profile_slot)current_phase, phase_start);
+	}
+	current_phase = phase;
+	phase_start = profile_now();
+}
+
+uint16_t get_tick_overruns(void)
+{
+	uint16_t count;
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		count = overruns;
+	}
+	return count;
+}
+
+uint16_t get_tick_phase_overruns(tick_phase phase)
+{
+	if (phase >= TICK_PHASE_COUNT)
+	{
+		return 0;
+	}
+	
+	uint16_t count;
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		count = phase_overruns[phase];
+	}
+	return count;
+}
+
+// Fires once per control period
+ISR(TIMER4_COMPA_vect)
+{
+	uint16_t start = profile_now_irq_off();
+	// If the main loop hasn't gone back to waiting yet, it has blown its budget
+	tick_phase phase = current_phase;
+	if (tick_pending || phase != TICK_PHASE_IDLE)
+	{
+		if (overruns < UINT16_MAX) overruns++;
+		if (phase_overruns[phase] < UINT16_MAX) phase_overruns[phase]++;
+	}
+	tick_pending = true;
+	profile_record_isr(PROFILE_ISR_TICK, start);
+}
@@ -0,0 +1,82 @@
+/*
+ * control_tick.h
+ *
+ * Created: 2026-10-17
+ */ 
+
+
+#ifndef CONTROL_TICK_H_
+#define CONTROL_TICK_H_
+
+#include <stdint.h>
+
+// Default rate of the main control loop. Must be within CONTROL_TICK_MIN_HZ and CONTROL_TICK_MAX_HZ.
+#define CONTROL_TICK_HZ 100
+#define CONTROL_TICK_MIN_HZ 100
+#define CONTROL_TICK_MAX_HZ 1000
+
+// The stages of one control loop iteration, in the order they run.
+// The main loop marks which phase it is in so an overrun can be blamed on the phase that was running when the next tick fired.
+typedef enum
+{
+	TICK_PHASE_IDLE = 0,
+	TICK_PHASE_ACQUIRE = 1,
+	TICK_PHASE_FILTER = 2,
+	TICK_PHASE_DECIDE = 3,
+	TICK_PHASE_ACTUATE = 4,
+	TICK_PHASE_REPORT = 5
+} tick_phase;
+
+#define TICK_PHASE_COUNT 6
+
+/**
+ * \brief Configures TC4 to generate the control loop tick. Interrupts must be enabled separately.
+ * 
+ * \param rate_hz The tick rate in Hz, CONTROL_TICK_MIN_HZ to CONTROL_TICK_MAX_HZ.
+ * 
+ * \return int 0 if the operation was successful. Nonzero indicates an argument out of range.
+ */
+int setup_control_tick(uint16_t rate_hz);
+
+/**
+ * \brief Returns the rate the control tick was last set up with. Anything counting time in ticks should scale by this
+ * rather than CONTROL_TICK_HZ.
+ * 
+ * \return uint16_t The tick rate in Hz. CONTROL_TICK_HZ before setup_control_tick() has succeeded.
+ */
+uint16_t get_control_tick_rate(void);
+
+/**
+ * \brief Blocks until the next control tick, then marks the start of a new iteration in TICK_PHASE_ACQUIRE.
+ * Returns immediately if a tick has already fired since the last call (i.e. the previous iteration overran).
+ * 
+ * \return void
+ */
+void wait_for_control_tick(void);
+
+/**
+ * \brief Records which phase of the control loop is currently running.
+ * 
+ * \param phase The phase that is about to start.
+ * 
+ * \return void
+ */
+void set_tick_phase(tick_phase phase);
+
+/**
+ * \brief Returns the total number of ticks that fired before the previous iteration had finished.
+ * 
+ * \return uint16_t The overrun count. Saturates instead of wrapping.
+ */
+uint16_t get_tick_overruns(void);
+
+/**
+ * \brief Returns the number of overruns that happened while a particular phase was running.
+ * 
+ * \param phase The phase to query.
+ * 
+ * \return uint16_t The overrun count for that phase. Saturates instead of wrapping.
+ */
+uint16_t get_tick_phase_overruns(tick_phase phase);
+
+#endif /* CONTROL_TICK_H_ */
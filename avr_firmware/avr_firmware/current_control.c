@@ -0,0 +1,68 @@
+/*
+ * current_control.c
+ *
+ * Created: 2026-10-17
+ */
+
+#include "current_control.h"
+
+#include "motor.h"
+
+// Largest duty in controller units. OCRnx are 8 bits wide.
+#define DUTY_MAX ((int16_t)UINT8_MAX << CURRENT_FRAC_BITS)
+
+static uint16_t setpoints[MOTOR_COUNT];
+// Integral term in duty steps with CURRENT_FRAC_BITS fractional bits. Always within 0 to DUTY_MAX.
+static int16_t integrals[MOTOR_COUNT];
+
+int set_current_setpoint(motor motor_num, uint16_t setpoint)
+{
+	if (motor_num >= MOTOR_COUNT || setpoint > CURRENT_SETPOINT_MAX)
+	{
+		return 1;
+	}
+
+	setpoints[motor_num] = setpoint;
+	return 0;
+}
+
+void reset_current_control(motor motor_num)
+{
+	if (motor_num < MOTOR_COUNT)
+	{
+		integrals[motor_num] = 0;
+	}
+}
+
+uint8_t update_current_control(motor motor_num, uint16_t measured)
+{
+	if (motor_num >= MOTOR_COUNT)
+	{
+		return 0;
+	}
+
+	// Errors are at most +-1023, so every product and sum below fits in an int16_t
+	int16_t error = (int16_t)setpoints[motor_num] - (int16_t)measured;
+	int16_t integral = integrals[motor_num];
+	int16_t output = error * CURRENT_KP + integral;
+
+	// Only integrate when it would move the output back into range
+	if ((output < DUTY_MAX || error < 0) && (output > 0 || error > 0))
+	{
+		integral += error * CURRENT_KI;
+		if (integral < 0) integral = 0;
+		if (integral > DUTY_MAX) integral = DUTY_MAX;
+		integrals[motor_num] = integral;
+		output = error * CURRENT_KP + integral;
+	}
+
+	if (output <= 0)
+	{
+		return 0;
+	}
+	if (output >= DUTY_MAX)
+	{
+		return UINT8_MAX;
+	}
+	return (uint8_t)(output >> CURRENT_FRAC_BITS);
+}
@@ -0,0 +1,54 @@
+/*
+ * current_control.h
+ *
+ * Created: 2026-10-17
+ */
+
+
+#ifndef CURRENT_CONTROL_H_
+#define CURRENT_CONTROL_H_
+
+#include <stdint.h>
+
+#include "glove_enums.h"
+
+// PI gains, in duty steps per ADC count of error with CURRENT_FRAC_BITS fractional bits.
+// The integral gain is applied once per control tick.
+#define CURRENT_FRAC_BITS 4
+#define CURRENT_KP 4
+#define CURRENT_KI 1
+
+// Largest setpoint, the full scale of the IPROPI reading
+#define CURRENT_SETPOINT_MAX 1023
+
+/**
+ * \brief Sets the motor current the controller tries to hold.
+ *
+ * \param motor_num The motor to change.
+ * \param setpoint Target IPROPI reading in 10 bit ADC counts, 0 to CURRENT_SETPOINT_MAX.
+ *
+ * \return int 0 if the operation was successful. Nonzero indicates an argument out of range.
+ */
+int set_current_setpoint(motor motor_num, uint16_t setpoint);
+
+/**
+ * \brief Clears a motor's integrator, so the next update starts from zero duty. Call whenever the motor is stopped or reversed.
+ *
+ * \param motor_num The motor to reset.
+ *
+ * \return void
+ */
+void reset_current_control(motor motor_num);
+
+/**
+ * \brief Runs one step of a motor's PI current controller. Call once per control tick while the motor is driven.
+ * The integrator stops accumulating while the output is saturated so it doesn't wind up.
+ *
+ * \param motor_num The motor to update.
+ * \param measured The latest IPROPI reading in 10 bit ADC counts.
+ *
+ * \return uint8_t The duty cycle to pass to set_motor_speed().
+ */
+uint8_t update_current_control(motor motor_num, uint16_t measured);
+
+#endif /* CURRENT_CONTROL_H_ */
@@ -0,0 +1,89 @@
+/*
+ * filter.c
+ *
+ * Created: 2026-10-17
+ */
+
+#include "filter.h"
+
+#include <stddef.h>
+
+#include "hal.h"
+#include "profiler.h"
+
+static filter_config_t configs[FILTER_GROUP_COUNT] =
+{
+	{ false, FILTER_DEFAULT_IIR_SHIFT, 0 },
+	{ false, FILTER_DEFAULT_IIR_SHIFT, 0 }
+};
+
+int set_filter_config(filter_group group, const filter_config_t *config)
+{
+	if (group >= FILTER_GROUP_COUNT || config == NULL
+		|| config->iir_shift > FILTER_MAX_IIR_SHIFT || config->oversample_shift > FILTER_MAX_OVERSAMPLE_SHIFT)
+	{
+		return 1;
+	}
+
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		configs[group] = *config;
+	}
+	return 0;
+}
+
+void get_filter_config(filter_group group, filter_config_t *dest)
+{
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		*dest = configs[group];
+	}
+}
+
+void reset_filter_channel(filter_channel_t *channel)
+{
+	channel->history[0] = 0;
+	channel->history[1] = 0;
+	channel->state = 0;
+}
+
+void seed_filter_channel(filter_channel_t *channel, int16_t value)
+{
+	channel->history[0] = value;
+	channel->history[1] = value;
+	channel->state = value;
+}
+
+static inline int16_t median3(int16_t a, int16_t b, int16_t c)
+{
+	if (a > b)
+	{
+		int16_t t = a;
+		a = b;
+		b = t;
+	}
+	// a <= b, so the median is b unless c is below it
+	if (c < b)
+	{
+		b = a > c ? a : c;
+	}
+	return b;
+}
+
+int16_t run_filter(filter_channel_t *channel, const filter_config_t *config, uint16_t sum)
+{
+	// Averaging 2^n conversions leaves n extra bits of resolution, which become fractional bits of the state
+	int16_t x = (int16_t)(sum << (FILTER_STATE_FRAC_BITS - config->oversample_shift));
+
+	// The history is kept even while the median is off, so turning it on doesn't start from stale samples
+	int16_t newest = x;
+	if (config->median)
+	{
+		x = median3(x, channel->history[0], channel->history[1]);
+	}
+	channel->history[1] = channel->history[0];
+	channel->history[0] = newest;
+
+	channel->state += (x - channel->state) >> config->iir_shift;
+	return channel->state;
+}
@@ -0,0 +1,97 @@
+/*
+ * filter.h
+ *
+ * Created: 2026-10-17
+ */
+
+
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Channels that share one set of filter settings
+typedef enum
+{
+	FILTER_GROUP_POTS = 0,
+	FILTER_GROUP_MOTORS = 1
+} filter_group;
+
+#define FILTER_GROUP_COUNT 2
+
+// Fractional bits kept in the filter state. 10 bit readings with 5 fractional bits still fit in an int16_t.
+#define FILTER_STATE_FRAC_BITS 5
+
+// Largest IIR shift. The filter weight for each new sample is 1/2^shift, so 0 turns the IIR off.
+#define FILTER_MAX_IIR_SHIFT 6
+// Largest oversampling shift. Each reading averages 2^shift back to back conversions.
+#define FILTER_MAX_OVERSAMPLE_SHIFT 2
+
+#define FILTER_DEFAULT_IIR_SHIFT 3
+
+typedef struct
+{
+	bool median;					// Median of the last 3 samples before the IIR, to reject single sample spikes
+	uint8_t iir_shift;				// 0 to FILTER_MAX_IIR_SHIFT
+	uint8_t oversample_shift;		// 0 to FILTER_MAX_OVERSAMPLE_SHIFT
+} filter_config_t;
+
+// Per channel state, owned by whoever runs the filter
+typedef struct
+{
+	int16_t history[2];				// Last two samples, newest first
+	int16_t state;					// IIR output
+} filter_channel_t;
+
+/**
+ * \brief Changes the settings for a group of channels. The ADC scan picks them up from the next scan on.
+ *
+ * \param group The group to change.
+ * \param config The new settings.
+ *
+ * \return int 0 if the operation was successful. Nonzero indicates an argument out of range.
+ */
+int set_filter_config(filter_group group, const filter_config_t *config);
+
+/**
+ * \brief Copies out the settings for a group of channels. Safe to call from an ISR.
+ *
+ * \param group The group to query.
+ * \param dest The settings to fill in.
+ *
+ * \return void
+ */
+void get_filter_config(filter_group group, filter_config_t *dest);
+
+/**
+ * \brief Clears a channel's history, so its output starts again from 0.
+ *
+ * \param channel The channel to reset.
+ *
+ * \return void
+ */
+void reset_filter_channel(filter_channel_t *channel);
+
+/**
+ * \brief Starts a channel's history at a known value, as if it had been reading that value for a long time.
+ *
+ * \param channel The channel to seed.
+ * \param value The value in ADC counts with FILTER_STATE_FRAC_BITS fractional bits.
+ *
+ * \return void
+ */
+void seed_filter_channel(filter_channel_t *channel, int16_t value);
+
+/**
+ * \brief Feeds one reading through median, IIR and back out.
+ *
+ * \param channel The channel's state.
+ * \param config Settings to apply. Must be the ones sum was oversampled with.
+ * \param sum Sum of the 2^oversample_shift conversions making up this reading.
+ *
+ * \return int16_t The filter output in ADC counts with FILTER_STATE_FRAC_BITS fractional bits.
+ */
+int16_t run_filter(filter_channel_t *channel, const filter_config_t *config, uint16_t sum);
+
+#endif /* FILTER_H_ */
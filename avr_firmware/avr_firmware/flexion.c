@@ -0,0 +1,85 @@
+/*
+ * flexion.c
+ *
+ * Created: 2026-10-17
+ */
+
+#include "flexion.h"
+
+#include <stdbool.h>
+
+#include "motor.h"
+
+// Total flexion of each finger over the last FLEXION_WINDOW scans, at full kinematic resolution
+static int16_t history[MOTOR_COUNT][FLEXION_WINDOW];
+static uint8_t history_pos;
+static uint8_t history_fill;
+static int8_t directions[MOTOR_COUNT];
+
+// Thresholds pre-scaled to kinematic resolution so the per-scan math is just subtractions and compares
+static int16_t stop_threshold = FLEXION_DEFAULT_DEADBAND << FLEXION_UNIT_SHIFT;
+static int16_t start_threshold = (FLEXION_DEFAULT_DEADBAND + FLEXION_DEFAULT_HYSTERESIS) << FLEXION_UNIT_SHIFT;
+
+void reset_flexion(void)
+{
+	history_pos = 0;
+	history_fill = 0;
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		directions[i] = 0;
+	}
+}
+
+int set_flexion_thresholds(uint8_t deadband, uint8_t hysteresis)
+{
+	uint16_t start = (uint16_t)deadband + hysteresis;
+	if (start == 0 || start > UINT8_MAX)
+	{
+		return 1;
+	}
+
+	stop_threshold = (int16_t)deadband << FLEXION_UNIT_SHIFT;
+	start_threshold = (int16_t)start << FLEXION_UNIT_SHIFT;
+	return 0;
+}
+
+void update_flexion(const finger_pose_t *poses, flexion_t *dest)
+{
+	// The slot about to be overwritten holds the position from FLEXION_WINDOW scans ago
+	uint8_t oldest = history_pos;
+	bool primed = history_fill == FLEXION_WINDOW;
+
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		int16_t position = poses[i].flexion;
+
+		// A positive velocity is flexion
+		int16_t velocity = primed ? position - history[i][oldest] : 0;
+		history[i][oldest] = position;
+
+		int8_t direction = directions[i];
+		if (velocity >= start_threshold)
+		{
+			direction = 1;
+		}
+		else if (velocity <= -start_threshold)
+		{
+			direction = -1;
+		}
+		else if ((direction > 0 && velocity < stop_threshold) || (direction < 0 && velocity > -stop_threshold))
+		{
+			direction = 0;
+		}
+		directions[i] = direction;
+
+		uint16_t speed = (uint16_t)(velocity < 0 ? -velocity : velocity) >> FLEXION_UNIT_SHIFT;
+		dest[i].direction = direction;
+		dest[i].speed = speed > UINT8_MAX ? UINT8_MAX : (uint8_t)speed;
+	}
+
+	history_pos = (history_pos + 1) & (FLEXION_WINDOW - 1);
+	if (!primed)
+	{
+		history_fill++;
+	}
+}
@@ -0,0 +1,62 @@
+/*
+ * flexion.h
+ *
+ * Created: 2026-10-17
+ */
+
+
+#ifndef FLEXION_H_
+#define FLEXION_H_
+
+#include <stdint.h>
+
+#include "glove_enums.h"
+#include "kinematics.h"
+
+// Number of scans the velocity is measured across. Must be a power of 2.
+#define FLEXION_WINDOW 4
+
+// Thresholds and speeds are in 2^FLEXION_UNIT_SHIFT KIN_TURN units, 1/4096 of a turn (about 0.09 degrees), per FLEXION_WINDOW scans
+#define FLEXION_UNIT_SHIFT 2
+
+// Default thresholds, in change of a finger's total flexion.
+// A finger starts moving once its speed reaches deadband + hysteresis, and stops once it falls below deadband.
+#define FLEXION_DEFAULT_DEADBAND 3
+#define FLEXION_DEFAULT_HYSTERESIS 2
+
+typedef struct
+{
+	int8_t direction;	// 1 if the finger is flexing, -1 if it is extending, 0 if it is still
+	uint8_t speed;		// Change of total flexion per FLEXION_WINDOW scans, saturated at 255
+} flexion_t;
+
+/**
+ * \brief Forgets every finger's history. The next FLEXION_WINDOW scans refill it and report every finger as still.
+ *
+ * \return void
+ */
+void reset_flexion(void);
+
+/**
+ * \brief Sets the movement thresholds used by every finger.
+ *
+ * \param deadband Speed below which a moving finger is considered still again.
+ * \param hysteresis Extra speed above the deadband needed before a still finger is considered moving.
+ *
+ * \return int 0 if the operation was successful. Nonzero indicates the thresholds are out of range.
+ */
+int set_flexion_thresholds(uint8_t deadband, uint8_t hysteresis);
+
+/**
+ * \brief Updates the velocity estimate of every finger from a new scan. Call once per scan, not once per control tick,
+ * as the window is counted in scans.
+ * Each finger's velocity is the change of its total flexion over the last FLEXION_WINDOW scans.
+ *
+ * \param poses Array of MOTOR_COUNT finger poses from the latest scan, indexed by motor.
+ * \param dest Array of MOTOR_COUNT results, indexed by motor.
+ *
+ * \return void
+ */
+void update_flexion(const finger_pose_t *poses, flexion_t *dest);
+
+#endif /* FLEXION_H_ */
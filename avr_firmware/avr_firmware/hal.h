@@ -0,0 +1,67 @@
+/*
+ * hal.h
+ *
+ * Created: 2026-10-17
+ */ 
+
+
+#ifndef HAL_H_
+#define HAL_H_
+
+// The clock rate of the system is 8 MHz.
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#include <stdint.h>
+
+// Every source file gets the AVR register definitions through this header instead of including the avr-libc headers directly.
+// On the target this is a zero-cost pass-through. With HOST_BUILD defined, the registers are plain variables and the few
+// accesses with side effects (SPI and UART data registers) go to a simulation in hal_host.c, so the firmware can run as a native executable.
+#ifdef HOST_BUILD
+
+#include "hal_host.h"
+
+#else
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+#include <util/delay.h>
+
+// Starts an SPI1 transfer by loading the data register
+static inline void hal_spi1_write(uint8_t data)
+{
+	SPDR1 = data;
+}
+
+// Reads the byte received by the last SPI1 transfer
+static inline uint8_t hal_spi1_read(void)
+{
+	return SPDR1;
+}
+
+// Loads the transmit data register of USART0 (link 0) or USART1 (link 1). link is a constant wherever this is called, so the branch is compiled out.
+static inline void hal_uart_write(uint8_t link, uint8_t data)
+{
+	if (link == 0) UDR0 = data;
+	else UDR1 = data;
+}
+
+// Reads the receive data register of USART0 (link 0) or USART1 (link 1)
+static inline uint8_t hal_uart_read(uint8_t link)
+{
+	return link == 0 ? UDR0 : UDR1;
+}
+
+// Called from busy-wait loops. On the target the interrupts happen on their own, so there is nothing to do.
+static inline void hal_idle(void)
+{
+}
+
+#endif
+
+#endif /* HAL_H_ */
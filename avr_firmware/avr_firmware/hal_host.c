@@ -0,0 +1,506 @@
+/*
+ * hal_host.c
+ *
+ * Created: 2026-10-17
+ *
+ * Simulated ATmega328PB peripherals for running the firmware as a native executable. Only compiled with HOST_BUILD defined.
+ * From this directory:
+ *   gcc -std=gnu99 -O2 -DHOST_BUILD -funsigned-char -fshort-enums -o glove_host *.c -lm
+ * Add -fsanitize=address,undefined to run under the sanitizers, or -pg to profile.
+ *
+ * The simulation is event driven: the firmware runs at host speed, and whenever it busy-waits (hal_idle) or delays,
+ * simulated time jumps straight to the next peripheral event (SPI byte done, UART character done, timer compare/overflow)
+ * and the corresponding ISR is called. This runs the control loop far faster than real time.
+ *
+ * Environment variables:
+ *   GLOVE_SIM_SECONDS  Simulated time to run before exiting (default 10)
+ *   GLOVE_SIM_TX0      File to write everything sent on USART0 (Bluetooth) to
+ *   GLOVE_SIM_TX1      File to write everything sent on USART1 (debug) to
+ *   GLOVE_SIM_RX0      File whose contents are received on USART0 at startup
+ *   GLOVE_SIM_RX1      File whose contents are received on USART1 at startup
+ */ 
+
+#ifdef HOST_BUILD
+
+#include "hal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#define HAL_DEFINE_REG8(name) volatile uint8_t name;
+#define HAL_DEFINE_REG16(name) volatile uint16_t name;
+
+HAL_DEFINE_REG8(PORTB) HAL_DEFINE_REG8(PORTC) HAL_DEFINE_REG8(PORTD) HAL_DEFINE_REG8(PORTE)
+HAL_DEFINE_REG8(DDRB) HAL_DEFINE_REG8(DDRC) HAL_DEFINE_REG8(DDRD) HAL_DEFINE_REG8(DDRE)
+HAL_DEFINE_REG8(PINB) HAL_DEFINE_REG8(PINC) HAL_DEFINE_REG8(PIND) HAL_DEFINE_REG8(PINE)
+HAL_DEFINE_REG8(SPCR1) HAL_DEFINE_REG8(SPSR1)
+HAL_DEFINE_REG8(TCCR0A) HAL_DEFINE_REG8(TCCR0B) HAL_DEFINE_REG8(OCR0A) HAL_DEFINE_REG8(OCR0B)
+HAL_DEFINE_REG8(TCCR1A) HAL_DEFINE_REG8(TCCR1B) HAL_DEFINE_REG16(OCR1A) HAL_DEFINE_REG16(OCR1B)
+HAL_DEFINE_REG8(TCCR2A) HAL_DEFINE_REG8(TCCR2B) HAL_DEFINE_REG8(OCR2A) HAL_DEFINE_REG8(OCR2B) HAL_DEFINE_REG8(TIMSK2)
+HAL_DEFINE_REG8(TCCR3A) HAL_DEFINE_REG8(TCCR3B) HAL_DEFINE_REG8(TIMSK3) HAL_DEFINE_REG8(TIFR3) HAL_DEFINE_REG16(TCNT3) HAL_DEFINE_REG16(OCR3A)
+HAL_DEFINE_REG8(TCCR4A) HAL_DEFINE_REG8(TCCR4B) HAL_DEFINE_REG8(TIMSK4) HAL_DEFINE_REG16(TCNT4) HAL_DEFINE_REG16(OCR4A)
+HAL_DEFINE_REG8(PCICR) HAL_DEFINE_REG8(PCMSK0) HAL_DEFINE_REG8(PCMSK2) HAL_DEFINE_REG8(PCMSK3)
+HAL_DEFINE_REG8(UCSR0A) HAL_DEFINE_REG8(UCSR0B) HAL_DEFINE_REG8(UCSR0C) HAL_DEFINE_REG8(UBRR0H) HAL_DEFINE_REG8(UBRR0L)
+HAL_DEFINE_REG8(UCSR1A) HAL_DEFINE_REG8(UCSR1B) HAL_DEFINE_REG8(UCSR1C) HAL_DEFINE_REG8(UBRR1H) HAL_DEFINE_REG8(UBRR1L)
+
+// Default (empty) handlers for every vector the simulation can raise. The firmware's own ISR() definitions override these.
+#define HAL_WEAK_VECTOR(name) void name(void); __attribute__((weak)) void name(void) {}
+HAL_WEAK_VECTOR(SPI1_STC_vect)
+HAL_WEAK_VECTOR(TIMER3_OVF_vect)
+HAL_WEAK_VECTOR(TIMER3_COMPA_vect)
+HAL_WEAK_VECTOR(TIMER4_COMPA_vect)
+HAL_WEAK_VECTOR(USART0_UDRE_vect)
+HAL_WEAK_VECTOR(USART0_RX_vect)
+HAL_WEAK_VECTOR(USART1_UDRE_vect)
+HAL_WEAK_VECTOR(USART1_RX_vect)
+
+#define ADC_COUNT 3
+#define ADC_CHANNELS 8
+#define LINK_COUNT 2
+#define RX_QUEUE_SIZE 4096
+
+static bool initialized;
+static uint64_t now;
+static uint64_t end_cycles;
+static clock_t wall_start;
+
+// MCP3008 models. Every transaction the firmware does is exactly 3 bytes, so each chip only tracks where it is in the current one.
+static uint16_t adc_override[ADC_COUNT][ADC_CHANNELS];
+static bool adc_overridden[ADC_COUNT][ADC_CHANNELS];
+static uint8_t adc_byte[ADC_COUNT];
+static uint8_t adc_channel[ADC_COUNT];
+static uint8_t spi_rx;
+static uint64_t spi_done;	// 0 if no interrupt-driven transfer is in progress
+
+// Timer 3 is modelled from the time it was started, so TCNT3 can be kept up to date and overflow and compare can both be used.
+// The last counts each interrupt fired at stop an event from firing twice when time hasn't moved on.
+static bool tc3_running;
+static uint64_t tc3_prescale_running;
+static uint64_t tc3_start;
+static uint64_t tc3_last_ovf;
+static uint64_t tc3_last_compare;
+
+// Timer 4. 0 means not scheduled yet.
+static uint64_t tc4_next;
+static uint64_t tc4_compares;
+
+// UARTs
+static uint64_t udr_free[LINK_COUNT];
+static uint64_t tx_bytes[LINK_COUNT];
+static FILE* tx_files[LINK_COUNT];
+static void (*uart_sink)(uint8_t link, uint8_t data);
+static uint8_t rx_queue[LINK_COUNT][RX_QUEUE_SIZE];
+static uint16_t rx_head[LINK_COUNT];
+static uint16_t rx_tail[LINK_COUNT];
+static uint64_t rx_next[LINK_COUNT];
+static uint8_t rx_byte[LINK_COUNT];
+
+static void report_and_exit(void)
+{
+	double sim_seconds = (double)now / F_CPU;
+	double wall_seconds = (double)(clock() - wall_start) / CLOCKS_PER_SEC;
+	fprintf(stderr, "simulated %.3f s in %.3f s (%.0fx real time)\n", sim_seconds, wall_seconds, wall_seconds > 0 ? sim_seconds / wall_seconds : 0.0);
+	fprintf(stderr, "control ticks: %llu\n", (unsigned long long)tc4_compares);
+	for (uint8_t link = 0; link < LINK_COUNT; link++)
+	{
+		fprintf(stderr, "USART%u: sent %llu bytes\n", link, (unsigned long long)tx_bytes[link]);
+		if (tx_files[link]) fclose(tx_files[link]);
+	}
+	exit(0);
+}
+
+static void load_rx_file(uint8_t link, const char* path)
+{
+	FILE* f = fopen(path, "rb");
+	if (f == NULL)
+	{
+		perror(path);
+		exit(1);
+	}
+	uint8_t data[RX_QUEUE_SIZE];
+	size_t len = fread(data, 1, sizeof(data) - 1, f);
+	fclose(f);
+	hal_host_uart_inject(link, data, (uint16_t)len);
+}
+
+static void init(void)
+{
+	if (initialized) return;
+	initialized = true;
+	wall_start = clock();
+	
+	// All fault inputs have pull-ups and read high while the drivers are happy
+	PINB = PINC = PIND = PINE = 0xFF;
+	
+	const char* seconds = getenv("GLOVE_SIM_SECONDS");
+	end_cycles = (uint64_t)((seconds ? atof(seconds) : 10.0) * F_CPU);
+	
+	const char* tx_names[LINK_COUNT] = { "GLOVE_SIM_TX0", "GLOVE_SIM_TX1" };
+	const char* rx_names[LINK_COUNT] = { "GLOVE_SIM_RX0", "GLOVE_SIM_RX1" };
+	for (uint8_t link = 0; link < LINK_COUNT; link++)
+	{
+		const char* path = getenv(tx_names[link]);
+		if (path) tx_files[link] = fopen(path, "wb");
+		path = getenv(rx_names[link]);
+		if (path) load_rx_file(link, path);
+	}
+}
+
+/* Sensor and actuator models */
+
+// Duty cycle currently driven on a motor channel of ADC 2
+static uint8_t motor_duty(uint8_t channel)
+{
+	// Channels are wired pinky first, see the motor enum
+	switch (channel)
+	{
+		case 0: return OCR2B;
+		case 1: return (uint8_t)OCR1B;
+		case 2: return (uint8_t)OCR1A;
+		case 3: return OCR0B;
+		case 4: return OCR0A;
+		default: return 0;
+	}
+}
+
+static uint16_t adc_value(uint8_t adc, uint8_t channel)
+{
+	if (adc_overridden[adc][channel])
+	{
+		return adc_override[adc][channel];
+	}
+	
+	double t = (double)now / F_CPU;
+	double noise = (rand() % 5) - 2;
+	if (adc < 2)
+	{
+		// Each finger slowly flexes and extends, with a different phase per joint
+		double value = 512 + 300 * sin(2 * M_PI * 0.5 * t + adc * 7 + channel) + noise;
+		return (uint16_t)value & 0x3FF;
+	}
+	
+	// IPROPI current roughly proportional to duty while the drivers are awake
+	bool enabled = PORTB & (1<<PORTB0);
+	double value = enabled ? motor_duty(channel) * 3 + noise : 0;
+	return value < 0 ? 0 : (uint16_t)value & 0x3FF;
+}
+
+// Which ADC has its chip select low, or -1 if none
+static int selected_adc(void)
+{
+	if (!(PORTE & (1<<PORTE2))) return 0;
+	if (!(PORTC & (1<<PORTC2))) return 1;
+	if (!(PORTC & (1<<PORTC3))) return 2;
+	return -1;
+}
+
+static uint64_t spi_byte_cycles(void)
+{
+	static const uint8_t dividers[4] = { 4, 16, 64, 128 };
+	uint64_t divider = dividers[SPCR1 & 0x03];
+	if (SPSR1 & (1<<SPI2X1)) divider /= 2;
+	return 8 * divider;
+}
+
+static uint64_t uart_char_cycles(uint8_t link)
+{
+	uint16_t ubrr = link == 0 ? (UBRR0H << 8) | UBRR0L : (UBRR1H << 8) | UBRR1L;
+	bool u2x = (link == 0 ? UCSR0A : UCSR1A) & (1<<U2X0);
+	// Start bit, 8 data bits, stop bit
+	return 10ULL * (u2x ? 8 : 16) * (ubrr + 1);
+}
+
+static uint64_t timer_prescale(uint8_t tccrb)
+{
+	static const uint16_t prescales[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+	return prescales[tccrb & 0x07];
+}
+
+/* Peripheral data registers */
+
+void hal_spi1_write(uint8_t data)
+{
+	init();
+	
+	int adc = selected_adc();
+	spi_rx = 0xFF;
+	if (adc >= 0)
+	{
+		switch (adc_byte[adc])
+		{
+		case 0:
+			// Start bit
+			spi_rx = 0;
+			break;
+		case 1:
+			// Single ended channel select, answered with the top 2 bits
+			adc_channel[adc] = (data >> 4) & 0x07;
+			spi_rx = adc_value(adc, adc_channel[adc]) >> 8;
+			break;
+		default:
+			spi_rx = adc_value(adc, adc_channel[adc]) & 0xFF;
+			break;
+		}
+		adc_byte[adc] = (adc_byte[adc] + 1) % 3;
+	}
+	
+	if (SPCR1 & (1<<SPIE1))
+	{
+		spi_done = now + spi_byte_cycles();
+	}
+	else
+	{
+		// Polled transfers complete instantly
+		now += spi_byte_cycles();
+		SPSR1 |= (1<<SPIF1);
+	}
+}
+
+uint8_t hal_spi1_read(void)
+{
+	SPSR1 &= ~(1<<SPIF1);
+	return spi_rx;
+}
+
+void hal_uart_write(uint8_t link, uint8_t data)
+{
+	init();
+	udr_free[link] = (udr_free[link] > now ? udr_free[link] : now) + uart_char_cycles(link);
+	tx_bytes[link]++;
+	if (tx_files[link]) fputc(data, tx_files[link]);
+	if (uart_sink) uart_sink(link, data);
+}
+
+uint8_t hal_uart_read(uint8_t link)
+{
+	return rx_byte[link];
+}
+
+/* Event loop */
+
+typedef enum
+{
+	EVENT_NONE,
+	EVENT_SPI,
+	EVENT_TC3_OVF,
+	EVENT_TC3_COMPA,
+	EVENT_TC4,
+	EVENT_UDRE0,
+	EVENT_UDRE1,
+	EVENT_RX0,
+	EVENT_RX1
+} event;
+
+// Timer 3 counts since it was started. In CTC mode (WGM32) it counts 0 to OCR3A and never overflows.
+static uint64_t tc3_count(uint64_t prescale)
+{
+	return (now - tc3_start) / prescale;
+}
+
+// Returns the first count at or after count that is offset modulo period, skipping last if it has already fired there
+static uint64_t next_count(uint64_t count, uint64_t period, uint64_t offset, uint64_t last)
+{
+	uint64_t next = count - count % period + offset;
+	if (next < count) next += period;
+	if (next == last) next += period;
+	return next;
+}
+
+static void consider(event* best, uint64_t* best_time, event candidate, uint64_t time)
+{
+	if (*best == EVENT_NONE || time < *best_time)
+	{
+		*best = candidate;
+		*best_time = time;
+	}
+}
+
+// Finds the next peripheral event, scheduling periodic timers that have just been enabled
+static event next_event(uint64_t* time)
+{
+	event best = EVENT_NONE;
+	
+	if (spi_done) consider(&best, time, EVENT_SPI, spi_done);
+	
+	uint64_t tc3_prescale = timer_prescale(TCCR3B);
+	// Changing the prescaler restarts the count from 0, which is close enough for anything the firmware does
+	if (tc3_prescale && (!tc3_running || tc3_prescale != tc3_prescale_running))
+	{
+		tc3_running = true;
+		tc3_prescale_running = tc3_prescale;
+		tc3_start = now;
+		tc3_last_ovf = 0;
+		tc3_last_compare = UINT64_MAX;
+	}
+	else if (!tc3_prescale)
+	{
+		tc3_running = false;
+	}
+	if (tc3_running)
+	{
+		uint64_t count = tc3_count(tc3_prescale);
+		bool ctc = TCCR3B & (1<<WGM32);
+		uint64_t period = ctc ? OCR3A + 1ULL : 65536ULL;
+		if ((TIMSK3 & (1<<TOIE3)) && !ctc)
+		{
+			consider(&best, time, EVENT_TC3_OVF, tc3_start + next_count(count, period, 0, tc3_last_ovf) * tc3_prescale);
+		}
+		if (TIMSK3 & (1<<OCIE3A))
+		{
+			consider(&best, time, EVENT_TC3_COMPA, tc3_start + next_count(count, period, OCR3A, tc3_last_compare) * tc3_prescale);
+		}
+	}
+	
+	uint64_t tc4_prescale = timer_prescale(TCCR4B);
+	if (tc4_prescale && (TIMSK4 & (1<<OCIE4A)))
+	{
+		if (tc4_next == 0) tc4_next = now + (OCR4A + 1ULL) * tc4_prescale;
+		consider(&best, time, EVENT_TC4, tc4_next);
+	}
+	else
+	{
+		tc4_next = 0;
+	}
+	
+	if ((UCSR0B & (1<<UDRIE0)) && (UCSR0B & (1<<TXEN0))) consider(&best, time, EVENT_UDRE0, udr_free[0] > now ? udr_free[0] : now);
+	if ((UCSR1B & (1<<UDRIE1)) && (UCSR1B & (1<<TXEN1))) consider(&best, time, EVENT_UDRE1, udr_free[1] > now ? udr_free[1] : now);
+	
+	for (uint8_t link = 0; link < LINK_COUNT; link++)
+	{
+		uint8_t ucsrb = link == 0 ? UCSR0B : UCSR1B;
+		if (rx_head[link] != rx_tail[link] && (ucsrb & (1<<RXCIE0)) && (ucsrb & (1<<RXEN0)))
+		{
+			if (rx_next[link] < now) rx_next[link] = now;
+			consider(&best, time, link == 0 ? EVENT_RX0 : EVENT_RX1, rx_next[link]);
+		}
+	}
+	
+	return best;
+}
+
+static void fire(event e)
+{
+	switch (e)
+	{
+	case EVENT_SPI:
+		spi_done = 0;
+		SPSR1 |= (1<<SPIF1);
+		SPI1_STC_vect();
+		break;
+	case EVENT_TC3_OVF:
+		tc3_last_ovf = tc3_count(timer_prescale(TCCR3B));
+		TIMER3_OVF_vect();
+		break;
+	case EVENT_TC3_COMPA:
+		tc3_last_compare = tc3_count(timer_prescale(TCCR3B));
+		TIMER3_COMPA_vect();
+		break;
+	case EVENT_TC4:
+		tc4_next = 0;
+		tc4_compares++;
+		TIMER4_COMPA_vect();
+		break;
+	case EVENT_UDRE0:
+		USART0_UDRE_vect();
+		break;
+	case EVENT_UDRE1:
+		USART1_UDRE_vect();
+		break;
+	case EVENT_RX0:
+	case EVENT_RX1:
+	{
+		uint8_t link = e == EVENT_RX0 ? 0 : 1;
+		rx_byte[link] = rx_queue[link][rx_tail[link]];
+		rx_tail[link] = (rx_tail[link] + 1) % RX_QUEUE_SIZE;
+		rx_next[link] = now + uart_char_cycles(link);
+		if (link == 0) USART0_RX_vect();
+		else USART1_RX_vect();
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+// Jumps to the time of an event and runs its ISR, or ends the simulation if it's over
+static void advance(event e, uint64_t time)
+{
+	now = time;
+	if (now >= end_cycles) report_and_exit();
+	if (tc3_running)
+	{
+		uint64_t count = tc3_count(timer_prescale(TCCR3B));
+		TCNT3 = (uint16_t)((TCCR3B & (1<<WGM32)) ? count % (OCR3A + 1ULL) : count);
+	}
+	fire(e);
+}
+
+void hal_idle(void)
+{
+	init();
+	
+	uint64_t time = 0;
+	event e = next_event(&time);
+	if (e == EVENT_NONE)
+	{
+		fprintf(stderr, "firmware is waiting with no peripheral events pending, it would hang here\n");
+		exit(1);
+	}
+	advance(e, time);
+}
+
+void _delay_us(double us)
+{
+	init();
+	
+	uint64_t target = now + (uint64_t)(us * (F_CPU / 1000000UL));
+	uint64_t time = 0;
+	event e;
+	while ((e = next_event(&time)) != EVENT_NONE && time <= target)
+	{
+		advance(e, time);
+	}
+	now = target;
+	if (now >= end_cycles) report_and_exit();
+}
+
+void _delay_ms(double ms)
+{
+	_delay_us(ms * 1000);
+}
+
+/* Simulation controls */
+
+void hal_host_set_adc(uint8_t adc, uint8_t channel, uint16_t value)
+{
+	if (adc >= ADC_COUNT || channel >= ADC_CHANNELS) return;
+	adc_override[adc][channel] = value & 0x3FF;
+	adc_overridden[adc][channel] = true;
+}
+
+void hal_host_uart_inject(uint8_t link, const uint8_t* data, uint16_t len)
+{
+	if (link >= LINK_COUNT) return;
+	for (uint16_t i = 0; i < len; i++)
+	{
+		uint16_t next = (rx_head[link] + 1) % RX_QUEUE_SIZE;
+		if (next == rx_tail[link]) break;
+		rx_queue[link][rx_head[link]] = data[i];
+		rx_head[link] = next;
+	}
+}
+
+uint64_t hal_host_cycles(void)
+{
+	return now;
+}
+
+void hal_host_set_uart_sink(void (*sink)(uint8_t link, uint8_t data))
+{
+	uart_sink = sink;
+}
+
+#endif /* HOST_BUILD */
@@ -0,0 +1,151 @@
+/*
+ * hal_host.h
+ *
+ * Created: 2026-10-17
+ */ 
+
+
+#ifndef HAL_HOST_H_
+#define HAL_HOST_H_
+
+// Stand-ins for the parts of avr-libc the firmware uses, for HOST_BUILD only. Include hal.h instead of this file.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Registers */
+// Only the registers the firmware touches. Names and bit positions match the ATmega328PB datasheet.
+#define HAL_REG8(name) extern volatile uint8_t name;
+#define HAL_REG16(name) extern volatile uint16_t name;
+
+HAL_REG8(PORTB) HAL_REG8(PORTC) HAL_REG8(PORTD) HAL_REG8(PORTE)
+HAL_REG8(DDRB) HAL_REG8(DDRC) HAL_REG8(DDRD) HAL_REG8(DDRE)
+HAL_REG8(PINB) HAL_REG8(PINC) HAL_REG8(PIND) HAL_REG8(PINE)
+HAL_REG8(SPCR1) HAL_REG8(SPSR1)
+HAL_REG8(TCCR0A) HAL_REG8(TCCR0B) HAL_REG8(OCR0A) HAL_REG8(OCR0B)
+HAL_REG8(TCCR1A) HAL_REG8(TCCR1B) HAL_REG16(OCR1A) HAL_REG16(OCR1B)
+// Low bytes of the 16 bit registers. The host is little-endian like the AVR.
+#define OCR1AL (*(volatile uint8_t*)&OCR1A)
+#define OCR1BL (*(volatile uint8_t*)&OCR1B)
+HAL_REG8(TCCR2A) HAL_REG8(TCCR2B) HAL_REG8(OCR2A) HAL_REG8(OCR2B) HAL_REG8(TIMSK2)
+HAL_REG8(TCCR3A) HAL_REG8(TCCR3B) HAL_REG8(TIMSK3) HAL_REG8(TIFR3) HAL_REG16(TCNT3) HAL_REG16(OCR3A)
+HAL_REG8(TCCR4A) HAL_REG8(TCCR4B) HAL_REG8(TIMSK4) HAL_REG16(TCNT4) HAL_REG16(OCR4A)
+HAL_REG8(PCICR) HAL_REG8(PCMSK0) HAL_REG8(PCMSK2) HAL_REG8(PCMSK3)
+HAL_REG8(UCSR0A) HAL_REG8(UCSR0B) HAL_REG8(UCSR0C) HAL_REG8(UBRR0H) HAL_REG8(UBRR0L)
+HAL_REG8(UCSR1A) HAL_REG8(UCSR1B) HAL_REG8(UCSR1C) HAL_REG8(UBRR1H) HAL_REG8(UBRR1L)
+
+enum { PORTB0, PORTB1, PORTB2, PORTB3, PORTB4, PORTB5, PORTB6, PORTB7 };
+enum { PORTC0, PORTC1, PORTC2, PORTC3, PORTC4, PORTC5, PORTC6 };
+enum { PORTD0, PORTD1, PORTD2, PORTD3, PORTD4, PORTD5, PORTD6, PORTD7 };
+enum { PORTE0, PORTE1, PORTE2, PORTE3 };
+enum { PINB0, PINB1, PINB2, PINB3, PINB4, PINB5, PINB6, PINB7 };
+enum { PIND0, PIND1, PIND2, PIND3, PIND4, PIND5, PIND6, PIND7 };
+enum { PINE0, PINE1, PINE2, PINE3 };
+enum { DDB0, DDB1, DDB2, DDB3, DDB4, DDB5, DDB6, DDB7 };
+enum { DDC0, DDC1, DDC2, DDC3, DDC4, DDC5, DDC6 };
+enum { DDD0, DDD1, DDD2, DDD3, DDD4, DDD5, DDD6, DDD7 };
+enum { DDE0, DDE1, DDE2, DDE3 };
+enum { SPR0 = 0, SPR1 = 1 };
+enum { SPR10, SPR11, CPHA1, CPOL1, MSTR1, DORD1, SPE1, SPIE1 };
+enum { SPI2X1 = 0, WCOL1 = 6, SPIF1 = 7 };
+enum { WGM00 = 0, WGM01 = 1, COM0B0 = 4, COM0B1 = 5, COM0A0 = 6, COM0A1 = 7, CS00 = 0, CS01 = 1, CS02 = 2 };
+enum { WGM10 = 0, WGM11 = 1, COM1B1 = 5, COM1A1 = 7, WGM12 = 3, CS10 = 0, CS11 = 1, CS12 = 2 };
+enum { WGM20 = 0, WGM21 = 1, COM2B1 = 5, COM2A1 = 7, CS20 = 0, CS21 = 1, CS22 = 2, TOIE2 = 0, OCIE2A = 1, WGM22 = 3 };
+enum { CS30 = 0, CS31 = 1, CS32 = 2, WGM32 = 3, WGM33 = 4, TOIE3 = 0, OCIE3A = 1, TOV3 = 0, OCF3A = 1 };
+enum { CS40 = 0, CS41 = 1, CS42 = 2, WGM42 = 3, WGM43 = 4, TOIE4 = 0, OCIE4A = 1 };
+enum { PCIE0 = 0, PCIE1 = 1, PCIE2 = 2, PCIE3 = 3 };
+enum { PCINT6 = 6, PCINT7 = 7, PCINT20 = 4, PCINT24 = 0, PCINT25 = 1 };
+enum { TXB80, RXB80, UCSZ02, TXEN0, RXEN0, UDRIE0, TXCIE0, RXCIE0 };
+enum { UCPOL0 = 0, UCSZ00 = 1, UCSZ01 = 2 };
+enum { MPCM0, U2X0, UPE0, DOR0, FE0, UDRE0, TXC0, RXC0 };
+enum { TXB81, RXB81, UCSZ12, TXEN1, RXEN1, UDRIE1, TXCIE1, RXCIE1 };
+enum { UCPOL1 = 0, UCSZ10 = 1, UCSZ11 = 2 };
+enum { MPCM1, U2X1, UPE1, DOR1, FE1, UDRE1, TXC1, RXC1 };
+
+/* avr/interrupt.h */
+// ISRs become plain functions that the simulation calls when the interrupt is due.
+#define ISR(vector) void vector(void)
+#define sei()
+#define cli()
+
+/* util/atomic.h */
+// Interrupts only ever fire from inside hal_idle(), so every block is already atomic.
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 0
+#define ATOMIC_BLOCK(type) for (uint8_t hal_atomic_once = 1; hal_atomic_once; hal_atomic_once = 0)
+
+/* avr/pgmspace.h */
+// There is only one address space on the host, so flash data is read like anything else
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+
+/* avr/eeprom.h */
+// EEMEM variables are ordinary statics, so the simulated EEPROM starts out zeroed and is lost when the process exits.
+// Like on the AVR they're gathered in a section of their own, so a test can get at all of it from __start_eeprom to __stop_eeprom.
+#define EEMEM __attribute__((section("eeprom")))
+static inline void eeprom_read_block(void* dst, const void* src, size_t n)
+{
+	memcpy(dst, src, n);
+}
+static inline void eeprom_update_block(const void* src, void* dst, size_t n)
+{
+	memcpy(dst, src, n);
+}
+static inline uint8_t eeprom_read_byte(const uint8_t* addr)
+{
+	return *addr;
+}
+static inline uint16_t eeprom_read_word(const uint16_t* addr)
+{
+	return *addr;
+}
+static inline void eeprom_update_byte(uint8_t* addr, uint8_t value)
+{
+	*addr = value;
+}
+static inline void eeprom_update_word(uint16_t* addr, uint16_t value)
+{
+	*addr = value;
+}
+
+/* util/crc16.h */
+// The C equivalent given in the avr-libc documentation
+static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data)
+{
+	data ^= crc & 0xFF;
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4) ^ ((uint16_t)data << 3));
+}
+
+/* util/delay.h */
+// Delays advance simulated time
+void _delay_ms(double ms);
+void _delay_us(double us);
+
+/* Peripheral data registers */
+void hal_spi1_write(uint8_t data);
+uint8_t hal_spi1_read(void);
+void hal_uart_write(uint8_t link, uint8_t data);
+uint8_t hal_uart_read(uint8_t link);
+
+// Advances simulated time to the next peripheral event and runs its ISR
+void hal_idle(void);
+
+/* Simulation controls */
+
+// Sets the value an MCP3008 channel converts to, 0-1023
+void hal_host_set_adc(uint8_t adc, uint8_t channel, uint16_t value);
+
+// Queues bytes to be received on USART0 (link 0) or USART1 (link 1), delivered one character time apart
+void hal_host_uart_inject(uint8_t link, const uint8_t* data, uint16_t len);
+
+// Returns the simulated time in CPU cycles since reset
+uint64_t hal_host_cycles(void);
+
+// Calls sink with every byte the firmware loads into a USART data register, for tests that check what goes out on the wire. NULL to stop.
+void hal_host_set_uart_sink(void (*sink)(uint8_t link, uint8_t data));
+
+#endif /* HAL_HOST_H_ */
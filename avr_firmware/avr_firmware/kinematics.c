@@ -0,0 +1,103 @@
+/*
+ * kinematics.c
+ *
+ * Created: 2026-10-17
+ */
+
+#include "kinematics.h"
+
+#include "hal.h"
+#include "motor.h"
+
+// The sine table covers a quarter turn in this many steps, so one step is 0.7 degrees
+#define SINE_QUARTER_STEPS 128
+// KIN_TURN units per sine table step, as a shift
+#define SINE_STEP_SHIFT 5
+
+// Phalanx lengths are stored with 5 fractional bits. Multiplied by a Q15 sine that leaves KIN_LENGTH_FRAC_BITS once the bottom 16 bits are dropped.
+#define LENGTH_FRAC_BITS (KIN_LENGTH_FRAC_BITS + 16 - 15)
+
+// Turns a joint's range of motion in degrees into the multiplier taking a calibrated angle to KIN_TURN units, with 16 fractional bits.
+// Ranges must be under 180 degrees to fit.
+#define ROM_GAIN(degrees) ((uint16_t)((((uint64_t)(degrees) * KIN_TURN) << 16) / (360UL * ((uint32_t)CAL_ANGLE_MAX << POT_FILTER_SHIFT))))
+
+// One joint and the phalanx after it
+#define JOINT(pot, rom_degrees, length_mm) { pot, ROM_GAIN(rom_degrees), (length_mm) << LENGTH_FRAC_BITS }
+
+// sin of 0 to 90 degrees, Q15 (sin 90 is clipped to 32767)
+static const int16_t sine_table[SINE_QUARTER_STEPS + 1] PROGMEM =
+{
+	0, 402, 804, 1206, 1608, 2009, 2411, 2811, 3212, 3612,
+	4011, 4410, 4808, 5205, 5602, 5998, 6393, 6787, 7180, 7571,
+	7962, 8351, 8740, 9127, 9512, 9896, 10279, 10660, 11039, 11417,
+	11793, 12167, 12540, 12910, 13279, 13646, 14010, 14373, 14733, 15091,
+	15447, 15800, 16151, 16500, 16846, 17190, 17531, 17869, 18205, 18538,
+	18868, 19195, 19520, 19841, 20160, 20475, 20788, 21097, 21403, 21706,
+	22006, 22302, 22595, 22884, 23170, 23453, 23732, 24008, 24279, 24548,
+	24812, 25073, 25330, 25583, 25833, 26078, 26320, 26557, 26791, 27020,
+	27246, 27467, 27684, 27897, 28106, 28311, 28511, 28707, 28899, 29086,
+	29269, 29448, 29622, 29792, 29957, 30118, 30274, 30425, 30572, 30715,
+	30853, 30986, 31114, 31238, 31357, 31471, 31581, 31686, 31786, 31881,
+	31972, 32058, 32138, 32214, 32286, 32352, 32413, 32470, 32522, 32568,
+	32610, 32647, 32679, 32706, 32729, 32746, 32758, 32766, 32767
+};
+
+typedef struct
+{
+	potentiometer pot;
+	uint16_t gain;					// KIN_TURN units per calibrated angle unit, with 16 fractional bits
+	int16_t length;					// Length of the next phalanx in mm, with LENGTH_FRAC_BITS fractional bits
+} joint_t;
+
+typedef struct
+{
+	joint_t joints[3];
+	uint8_t joint_count;
+} finger_geometry_t;
+
+// Joints of each finger from the hand outwards, indexed by motor. The thumb only has two.
+// Ranges of motion and lengths are typical adult values. A calibrated angle of 0 is the straightest the joint went during calibration.
+static const finger_geometry_t fingers[MOTOR_COUNT] =
+{
+	[MOTOR_PINKY] = { { JOINT(POT_PINKY_1, 90, 33), JOINT(POT_PINKY_2, 100, 18), JOINT(POT_PINKY_3, 80, 17) }, 3 },
+	[MOTOR_RING] = { { JOINT(POT_RING_1, 90, 42), JOINT(POT_RING_2, 100, 26), JOINT(POT_RING_3, 80, 19) }, 3 },
+	[MOTOR_MIDDLE] = { { JOINT(POT_MIDDLE_1, 90, 45), JOINT(POT_MIDDLE_2, 100, 27), JOINT(POT_MIDDLE_3, 80, 20) }, 3 },
+	[MOTOR_INDEX] = { { JOINT(POT_INDEX_1, 90, 40), JOINT(POT_INDEX_2, 100, 23), JOINT(POT_INDEX_3, 80, 18) }, 3 },
+	[MOTOR_THUMB] = { { JOINT(POT_THUMB_1, 60, 31), JOINT(POT_THUMB_2, 80, 26) }, 2 },
+};
+
+// step is an angle in sine table steps, any number of turns
+static int16_t sine(uint16_t step)
+{
+	uint8_t quadrant = (step / SINE_QUARTER_STEPS) & 3;
+	uint8_t index = step & (SINE_QUARTER_STEPS - 1);
+	// The second and fourth quadrants run back down the table, the third and fourth are negative
+	int16_t value = (int16_t)pgm_read_word(&sine_table[(quadrant & 1) ? SINE_QUARTER_STEPS - index : index]);
+	return (quadrant & 2) ? -value : value;
+}
+
+void update_kinematics(const joint_angles_t *angles, finger_pose_t *dest)
+{
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		const finger_geometry_t *finger = &fingers[i];
+		uint16_t theta = 0;
+		int32_t x = 0;
+		int32_t y = 0;
+		for (uint8_t k = 0; k < finger->joint_count; k++)
+		{
+			const joint_t *joint = &finger->joints[k];
+			// Angles are never negative, and the top 16 bits of the product are a whole byte shift
+			theta += ((uint32_t)(uint16_t)angles->joints[joint->pot] * joint->gain) >> 16;
+
+			// Each phalanx points along the sum of the joint angles before it, rounded to the nearest table step
+			uint16_t step = (theta + (1 << (SINE_STEP_SHIFT - 1))) >> SINE_STEP_SHIFT;
+			x += (int32_t)joint->length * sine(step + SINE_QUARTER_STEPS);
+			y += (int32_t)joint->length * sine(step);
+		}
+
+		dest[i].flexion = (int16_t)theta;
+		dest[i].tip_x = (int16_t)(x >> 16);
+		dest[i].tip_y = (int16_t)(y >> 16);
+	}
+}
@@ -0,0 +1,45 @@
+/*
+ * kinematics.h
+ *
+ * Created: 2026-10-17
+ */
+
+
+#ifndef KINEMATICS_H_
+#define KINEMATICS_H_
+
+#include <stdint.h>
+
+#include "glove_enums.h"
+#include "calibration.h"
+
+// Kinematic angles are binary angles with this many units per full turn (about 0.022 degrees per unit)
+#define KIN_TURN 16384
+
+// Fractional bits of the fingertip coordinates, which are in mm
+#define KIN_LENGTH_FRAC_BITS 4
+
+// Most cycles update_kinematics() should take, half of a control tick at CONTROL_TICK_MAX_HZ.
+// The benchmark run fails if it's over. On the glove it runs in TICK_PHASE_FILTER, so the profiler's filter slot shows what it costs there.
+#define KINEMATICS_CYCLE_BUDGET 4000
+
+// Where a finger is, in the plane it bends in. The origin is the knuckle joining it to the hand.
+typedef struct
+{
+	int16_t flexion;		// Sum of the joint angles, 0 when straight, in KIN_TURN units
+	int16_t tip_x;			// Fingertip distance along the straight finger, in mm with KIN_LENGTH_FRAC_BITS fractional bits
+	int16_t tip_y;			// Fingertip distance towards the palm, in mm with KIN_LENGTH_FRAC_BITS fractional bits
+} finger_pose_t;
+
+/**
+ * \brief Works out the pose of every finger from the joint angles of a scan. Each joint's calibrated angle is scaled to its
+ * range of motion, and the phalanges are chained with a sine table, so everything is multiplies and lookups.
+ *
+ * \param angles Joint angles of the latest scan.
+ * \param dest Array of MOTOR_COUNT poses to fill in, indexed by motor.
+ *
+ * \return void
+ */
+void update_kinematics(const joint_angles_t *angles, finger_pose_t *dest);
+
+#endif /* KINEMATICS_H_ */
@@ -5,30 +5,142 @@
  * Author : Matthew Faigan
  */ 
 
-#define F_CPU 8000000UL
-
-#include <avr/io.h>
-#include <avr/interrupt.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
-#include <util/delay.h>
 
+#include "hal.h"
 #include "spi.h"
 #include "uart.h"
 #include "motor.h"
+#include "control_tick.h"
+#include "command.h"
+#include "profiler.h"
+#include "flexion.h"
+#include "current_control.h"
+#include "motor_ramp.h"
+#include "soft_timer.h"
+#include "filter.h"
+#include "calibration.h"
+#include "kinematics.h"
+#include "repetition.h"
+#include "resistance_curve.h"
+
+// How long a motor keeps driving in the direction it picked before looking at the finger again, unless changed by the app
+#define DEFAULT_MOTOR_HOLD_MS 500
+
+// Longest the warm start keeps waiting for the readings to settle before starting anyway
+#define STARTUP_TIMEOUT_MS 1000
 
-// Number of timer 3 overflows to occur for ~0.5s of real time to pass
-#define TC3_OVF_HALF_SECOND 61
+// Space in the send buffer that periodic telemetry leaves free, so a motor warning for every motor always fits
+#define TX_RESERVED_BYTES (MOTOR_COUNT * BT_MOTOR_WARNING_FRAME_LEN)
 
 extern volatile bool motor_faulted[MOTOR_COUNT];
 
-static volatile int8_t motor_cycles_remaining[MOTOR_COUNT];
+static uint16_t motor_hold_ms[MOTOR_COUNT] =
+{
+	DEFAULT_MOTOR_HOLD_MS, DEFAULT_MOTOR_HOLD_MS, DEFAULT_MOTOR_HOLD_MS, DEFAULT_MOTOR_HOLD_MS, DEFAULT_MOTOR_HOLD_MS
+};
+
+typedef struct
+{
+	uint16_t current;	// Target motor current, in IPROPI ADC counts
+	uint8_t ramp_ms;	// Soft start/stop time
+} resistance_level_t;
+
+// Settings for each resistance level. Level 1 is the lightest resistance since the motors assist the movement,
+// so it drives the most current, and ramps for longest to keep the inrush below the drivers' fault threshold.
+// Currents are scaled from the old open-loop duty cycles (200 down to 100); retune against the real IPROPI resistor.
+// Ramp times can be changed by the app.
+static resistance_level_t resistance_levels[] =
+{
+	{ 600, 60 },
+	{ 525, 50 },
+	{ 450, 40 },
+	{ 375, 30 },
+	{ 300, 20 },
+};
+#define RESISTANCE_LEVEL_COUNT (sizeof(resistance_levels) / sizeof(resistance_levels[0]))
+#define DEFAULT_RESISTANCE_LEVEL 5
+
+static uint8_t resistance_level = DEFAULT_RESISTANCE_LEVEL;
+
+// Direction each motor is currently being driven in: 1 forward, -1 backward, 0 stopped
+static int8_t motor_drive[MOTOR_COUNT];
+
+static bool exercise_started = false;
+
+// Profiler pages the app has asked for that haven't been sent yet, one bit per page
+static uint8_t profile_pages_pending;
+// Clear the profiler once every pending page has gone out
+static bool profile_clear_pending;
+
+// Time from enabling interrupts to the first valid readings, and whether they had settled or the warm start timed out
+static uint16_t boot_ms;
+static bool boot_settled;
+
+// What the telemetry stream carries
+typedef enum
+{
+	TELEMETRY_READINGS = 0,		// Snapshot or delta frames of the raw readings
+	TELEMETRY_ANGLES = 1,		// The same frames with each pot replaced by its joint angle
+	TELEMETRY_POSES = 2,		// Finger pose frames
+	TELEMETRY_OFF = 3			// Nothing but rep summaries and replies, for long sessions on a congested link
+} telemetry_units;
+
+static telemetry_units telemetry = TELEMETRY_READINGS;
 
 void setup_gpio(void);
-int8_t check_finger_flexion(adc_readings_t *current, adc_readings_t *prev, potentiometer knuckle1, potentiometer knuckle2, potentiometer knuckle3);
+
+static void cmd_start_exercise(const uint8_t* args);
+static void cmd_stop_exercise(const uint8_t* args);
+static void cmd_set_resistance(const uint8_t* args);
+static void cmd_query_overruns(const uint8_t* args);
+static void cmd_set_telemetry_mode(const uint8_t* args);
+static void cmd_set_stream_link(const uint8_t* args);
+static void cmd_request_baud(const uint8_t* args);
+static void cmd_confirm_baud(const uint8_t* args);
+static void cmd_throughput_test(const uint8_t* args);
+static void cmd_query_profile(const uint8_t* args);
+static void cmd_set_flexion_thresholds(const uint8_t* args);
+static void cmd_set_ramp_time(const uint8_t* args);
+static void cmd_set_hold_time(const uint8_t* args);
+static void cmd_set_filter(const uint8_t* args);
+static void cmd_query_spi_clock(const uint8_t* args);
+static void cmd_query_boot_time(const uint8_t* args);
+static void cmd_calibrate(const uint8_t* args);
+static void cmd_set_telemetry_units(const uint8_t* args);
+static void cmd_stage_curve_point(const uint8_t* args);
+static void cmd_resistance_curve(const uint8_t* args);
+
+// Every command the app can send, framed as described in command.h. To add a new one, add a handler and an entry here.
+static const command_t commands[] =
+{
+	{ 0x01, 0, cmd_start_exercise },
+	{ 0x82, 0, cmd_stop_exercise },
+	{ 0x85, 1, cmd_set_resistance },
+	{ 0x86, 0, cmd_query_overruns },
+	{ 0x87, 1, cmd_set_telemetry_mode },
+	{ 0x88, 2, cmd_set_stream_link },
+	{ 0x89, 2, cmd_request_baud },
+	{ 0x8A, 1, cmd_confirm_baud },
+	{ 0x8B, 2, cmd_throughput_test },
+	{ 0x8C, 1, cmd_query_profile },
+	{ 0x8D, 2, cmd_set_flexion_thresholds },
+	{ 0x8E, 2, cmd_set_ramp_time },
+	{ 0x8F, 3, cmd_set_hold_time },
+	{ 0x90, 4, cmd_set_filter },
+	{ 0x91, 0, cmd_query_spi_clock },
+	{ 0x92, 0, cmd_query_boot_time },
+	{ 0x93, 1, cmd_calibrate },
+	{ 0x94, 1, cmd_set_telemetry_units },
+	{ 0x95, 6, cmd_stage_curve_point },
+	{ 0x96, 3, cmd_resistance_curve },
+};
 
 // REAL MAIN
+// The Benchmark configuration supplies its own main in benchmark.c
+#ifndef BENCHMARK
 int main(void)
 {
 	// SETUP
@@ -36,34 +148,91 @@ int main(void)
 	setup_spi();
 	setup_uart();
 	setup_motors();
+	// Run the ADCs as fast as this board allows. The result goes out once interrupts are enabled.
+	bt_send_spi_clock(calibrate_spi_clock());
+	set_ramp_time(resistance_levels[DEFAULT_RESISTANCE_LEVEL - 1].ramp_ms);
+	load_calibration();
+	load_resistance_curves();
 	
-	// Enable timer 3 to track motor active time
-	// No prescaling
+	// Enable timer 3 free running with no prescaling. The profiler reads TCNT3 as its cycle counter,
+	// which the soft timer tick extends so loop timings longer than one wrap still come out right.
 	TCCR3B = (1<<CS30);
-	// Overflow interrupt enabled
-	TIMSK3 = (1<<TOIE3);
+	TIMSK3 = 0;
+	// Compare A ticks the soft timers every 1ms, which step the motor ramps and time motor holds
+	setup_soft_timers();
+	setup_motor_ramps();
 	
-	// Current and previous ADC readings, used to detect movement
+	// Latest ADC readings, and the scan count they came from so each scan is only fed to the flexion detector once
 	adc_readings_t current_readings;
-	adc_readings_t old_readings;
 	memset(&current_readings, 0, sizeof(adc_readings_t));
-	memset(&old_readings, 0, sizeof(adc_readings_t));
+	uint8_t scan_count = 0;
+	// Pot readings converted to joint angles, and those to the pose of each finger, updated with every new scan
+	joint_angles_t joint_angles;
+	memset(&joint_angles, 0, sizeof(joint_angles_t));
+	finger_pose_t finger_poses[MOTOR_COUNT];
+	memset(finger_poses, 0, sizeof(finger_poses));
 	
-	bool exercise_started = false;
-	uint8_t motor_speed = 100;
+	// Direction and speed of every finger, kept between iterations in case a scan is late
+	flexion_t flexion[MOTOR_COUNT];
+	memset(flexion, 0, sizeof(flexion));
 	
-	potentiometer pot_index = POT_THUMB_1;
+	uint16_t reported_frames_dropped = 0;
 	
-	char recvbuf[64] = {0};
+	// One parser per link so commands arriving on both at once can't be interleaved
+	command_parser_t parsers[UART_LINK_COUNT];
+	for (uint8_t link = 0; link < UART_LINK_COUNT; link++)
+	{
+		command_parser_init(&parsers[link], commands, sizeof(commands) / sizeof(commands[0]));
+	}
+	char recvbuf[16];
 		
-	// Used to prevent triggering the motors until 255 iterations of the main loop have happened, while the filters stabilize.
-	uint8_t stabilize_delay = 255;
-	
 	sei();
 	set_motor_enable(1);
+	
+	// Seed the filters from bursts of raw samples until the readings settle, instead of waiting for the IIR to rise from 0.
+	// The startup timer bounds the wait on a noisy board and measures how long it took.
+	start_timer(TIMER_STARTUP, STARTUP_TIMEOUT_MS, 0);
+	while (timer_running(TIMER_STARTUP))
+	{
+		uint16_t variance;
+		if (warm_start_filters(&variance) == 0 && variance <= WARM_START_MAX_VARIANCE)
+		{
+			boot_settled = true;
+			break;
+		}
+		hal_idle();
+	}
+	boot_ms = STARTUP_TIMEOUT_MS - timer_remaining(TIMER_STARTUP);
+	stop_timer(TIMER_STARTUP);
+	bt_send_boot_time(boot_ms, boot_settled);
+	
+	// The control tick only starts now so the warm start isn't counted as overruns
+	setup_control_tick(CONTROL_TICK_HZ);
+	start_adc_scan(false);
 	// LOOP
+	// Each iteration is paced by the TC4 control tick and runs acquire -> filter -> decide -> actuate -> report.
 	while (1)
 	{
+		wait_for_control_tick();
+		
+		// Fetch the scan that ran in the background during the last tick, then kick off the next one.
+		// The SPI transfers overlap with the rest of the iteration instead of blocking it.
+		uint8_t latest_scan = get_latest_readings(&current_readings);
+		start_adc_scan(false);
+		
+		// Filtering happens in the scan ISR. Each new scan is turned into joint angles and finger poses here.
+		set_tick_phase(TICK_PHASE_FILTER);
+		bool new_scan = latest_scan != scan_count;
+		if (new_scan)
+		{
+			record_calibration(&current_readings);
+			readings_to_angles(&current_readings, &joint_angles);
+			update_kinematics(&joint_angles, finger_poses);
+			scan_count = latest_scan;
+		}
+		
+		set_tick_phase(TICK_PHASE_DECIDE);
+		
 		// Check for motor faults
 		for (size_t i = 0; i < MOTOR_COUNT; i++)
 		{
@@ -74,109 +243,132 @@ int main(void)
 			}
 		}
 		
-		// Check for incoming commands
-		// N.B. This should normally use the BT UART, but we are using an external module on the debug UART for the final demo because of timing issues.
-		debug_recv(recvbuf, 64);
-		if (recvbuf[0] == 0x85 && !exercise_started)
+		// Handle every complete command received on either link since the last tick.
+		// Commands are accepted on both so the app can always move the streams back if a link stops working.
+		for (uint8_t link = 0; link < UART_LINK_COUNT; link++)
 		{
-			// Set resistance, only while exercise is stopped.
-			// Higher resistance value => lower motor speed (smaller value set to 8 bit output compare register)
-			switch (recvbuf[1])
+			size_t recv_len;
+			while ((recv_len = uart_recv(link, recvbuf, sizeof(recvbuf))) > 0)
 			{
-				case 1:
-					motor_speed = 200;
-					break;
-				case 2:
-					motor_speed = 175;
-					break;
-				case 3:
-					motor_speed = 150;
-					break;
-				case 4:
-					motor_speed = 125;
-					break;
-				case 5:
-					motor_speed = 100;
-					break;
-				default:
-					break;
+				command_parser_feed(&parsers[link], recvbuf, recv_len, timer_now());
 			}
 		}
-		else if (recvbuf[0] == 0x01)
-		{
-			// Start exercise
-			exercise_started = true;
-			//set_motor_enable(1);
-		}
-		else if (recvbuf[0] == 0x82)
-		{
-			// Stop exercise
-			exercise_started = false;
-			//set_motor_enable(0);
-		}
+		uart_tick();
 		
-		// Read all pots and motors
-		memcpy(&old_readings, &current_readings, sizeof(adc_readings_t));
-		for (potentiometer i = POT_THUMB_1; i <= POT_PINKY_3; i++)
+		if (new_scan)
 		{
-			read_pot(i, &current_readings);
+			update_flexion(finger_poses, flexion);
+			
+			// The drive directions are still the ones set last tick, which is what the motors did since the previous scan
+			uint8_t resisted_mask = 0;
+			for (motor i = MOTOR_PINKY; i <= MOTOR_THUMB; i++)
+			{
+				if (motor_drive[i] != 0)
+				{
+					resisted_mask |= (1<<i);
+				}
+			}
+			update_repetitions(finger_poses, resisted_mask, timer_now());
 		}
+		
+		set_tick_phase(TICK_PHASE_ACTUATE);
 		for (motor i = MOTOR_PINKY; i <= MOTOR_THUMB; i++)
 		{
-			read_motor(i, &current_readings);
+			// Pick a new direction once the last activation has run for its hold time
+			soft_timer_id hold_timer = TIMER_MOTOR_HOLD + i;
+			if (!timer_running(hold_timer))
+			{
+				int8_t drive = flexion[i].direction;
+				if (drive != motor_drive[i])
+				{
+					// Start the controller from zero whenever the motor stops or reverses
+					reset_current_control(i);
+					motor_drive[i] = drive;
+				}
+				if (drive != 0)
+				{
+					start_timer(hold_timer, motor_hold_ms[i], 0);
+				}
+			}
+			
+			// Hold the current from the motor's resistance curve at the finger's position, or the resistance level's current
+			// if it has no curve, for as long as the motor is driven. The ramp timer takes care of soft starts, stops and reversals.
+			if (motor_drive[i] != 0)
+			{
+				uint16_t setpoint;
+				if (evaluate_resistance_curve(i, finger_poses[i].flexion, &setpoint) != 0)
+				{
+					setpoint = resistance_levels[resistance_level - 1].current;
+				}
+				set_current_setpoint(i, setpoint);
+				motor_direction direction = motor_drive[i] > 0 ? DIRECTION_FORWARD : DIRECTION_BACKWARD;
+				set_motor_target(i, direction, update_current_control(i, current_readings.motors[i] >> POT_FILTER_SHIFT));
+			}
+			else
+			{
+				set_motor_target(i, DIRECTION_FORWARD, 0);
+			}
 		}
-
-		// Wait for all the filters to stabilize before doing anything else
-		if (stabilize_delay > 0)
+		
+		set_tick_phase(TICK_PHASE_REPORT);
+		// Let the app know if anything has been dropped since the last report.
+		// Only sent when it fits, so the report itself can't add to the count.
+		uint16_t frames_dropped = bt_get_frames_dropped();
+		if (frames_dropped != reported_frames_dropped && bt_get_send_free() >= BT_FRAMES_DROPPED_FRAME_LEN + TX_RESERVED_BYTES)
 		{
-			stabilize_delay--;
-			continue;
+			bt_send_frames_dropped(frames_dropped);
+			reported_frames_dropped = frames_dropped;
 		}
 		
-		// Only send two readings per iteration to not overflow the send buffer
-		bt_send_reading(pot_index, current_readings.potentiometers[pot_index] >> POT_FILTER_SHIFT);
-		bt_send_reading(pot_index+1, current_readings.potentiometers[pot_index+1] >> POT_FILTER_SHIFT);
-		pot_index += 2;
-		if (pot_index > POT_PINKY_3)
+		// Completed reps go out before anything periodic. They stay queued until there's room, so throttled telemetry can't lose them.
+		rep_summary_t rep;
+		while (peek_repetition(&rep) && bt_get_send_free() >= BT_REPETITION_FRAME_LEN + TX_RESERVED_BYTES && bt_send_repetition(&rep) == 0)
 		{
-			pot_index = POT_THUMB_1;
+			pop_repetition();
 		}
 		
-		int8_t flexion[MOTOR_COUNT];
-		flexion[MOTOR_PINKY] = check_finger_flexion(&current_readings, &old_readings, POT_PINKY_1, POT_PINKY_2, POT_PINKY_3);
-		flexion[MOTOR_RING] = check_finger_flexion(&current_readings, &old_readings, POT_RING_1, POT_RING_2, POT_RING_3);
-		flexion[MOTOR_MIDDLE] = check_finger_flexion(&current_readings, &old_readings, POT_MIDDLE_1, POT_MIDDLE_2, POT_MIDDLE_3);
-		flexion[MOTOR_INDEX] = check_finger_flexion(&current_readings, &old_readings, POT_INDEX_1, POT_INDEX_2, POT_INDEX_3);
-		flexion[MOTOR_THUMB] = check_finger_flexion(&current_readings, &old_readings, POT_THUMB_1, POT_THUMB_2, POT_THUMB_2);
-		
-		for (motor i = MOTOR_PINKY; i <= MOTOR_THUMB; i++)
+		// Profiler pages are much bigger than anything else, so telemetry is held off until they've all gone out
+		if (profile_pages_pending)
 		{
-			if (motor_cycles_remaining[i] > 0)
+			for (uint8_t page = 0; page < PROFILE_PAGE_COUNT; page++)
 			{
-				continue;
+				if ((profile_pages_pending & (1<<page)) && bt_get_send_free() >= BT_PROFILE_MAX_FRAME_LEN + TX_RESERVED_BYTES && bt_send_profile(page) == 0)
+				{
+					profile_pages_pending &= ~(1<<page);
+				}
 			}
-			
-			if (flexion[i] > 0)
+			if (!profile_pages_pending && profile_clear_pending)
 			{
-				set_motor_phase(i, DIRECTION_FORWARD);
-				set_motor_speed(i, motor_speed);
-				motor_cycles_remaining[i] = TC3_OVF_HALF_SECOND;
+				clear_profile();
+				profile_clear_pending = false;
 			}
-			else if (flexion[i] < 0)
+		}
+		// Send a snapshot of the whole hand whenever the send buffer has room for one, keeping some space free for motor warnings.
+		// This matches the telemetry rate to whatever the link can sustain without dropping frames.
+		else if (telemetry == TELEMETRY_POSES)
+		{
+			if (bt_get_send_free() >= BT_POSE_FRAME_LEN + TX_RESERVED_BYTES)
 			{
-				set_motor_phase(i, DIRECTION_BACKWARD);
-				set_motor_speed(i, motor_speed);
-				motor_cycles_remaining[i] = TC3_OVF_HALF_SECOND;
+				bt_send_finger_poses(finger_poses);
+			}
+		}
+		else if (telemetry != TELEMETRY_OFF && bt_get_send_free() >= BT_SNAPSHOT_FRAME_LEN + TX_RESERVED_BYTES)
+		{
+			if (telemetry == TELEMETRY_ANGLES)
+			{
+				// Same frame, with each pot replaced by its angle at the same resolution
+				adc_readings_t report = current_readings;
+				memcpy(report.potentiometers, joint_angles.joints, sizeof(joint_angles.joints));
+				bt_send_telemetry(&report);
 			}
 			else
 			{
-				set_motor_speed(i, 0);
+				bt_send_telemetry(&current_readings);
 			}
 		}
-		
-		_delay_ms(10);
 	}
 }
+#endif
 
 /*
 // DEBUG TEST
@@ -378,48 +570,241 @@ int main(void)
 }
 */
 
-void setup_gpio(void)
+static void cmd_start_exercise(const uint8_t* args)
 {
-	// PORTxn : If port x, pin n is input: 1 enables internal pull-up. If port x, pin n is output: sets value of port.
-	// DDxn : Data Direction, Port x, Pin n. 1 = Output, 0 = Input
-	PORTB = (1<<PORTB7) | (1<<PORTB6);
-	DDRB = (1<<DDB0);
-	
-	PORTC = (1<<PORTC5) | (1<<PORTC3) | (1<<PORTC2);
-	DDRC = (1<<DDC5) | (1<<DDC4) | (1<<DDC3) | (1<<DDC2);
-	
-	PORTD = (1<<PORTD4);
-	DDRD = (1<<DDD7) | (1<<DDD2);
+	(void)args;
+	exercise_started = true;
+	// Count reps from the start of each exercise
+	reset_repetitions();
+	//set_motor_enable(1);
+}
+
+static void cmd_stop_exercise(const uint8_t* args)
+{
+	(void)args;
+	exercise_started = false;
+	//set_motor_enable(0);
+}
+
+static void cmd_set_resistance(const uint8_t* args)
+{
+	// Set resistance, only while exercise is stopped.
+	if (exercise_started)
+	{
+		return;
+	}
 	
-	PORTE = (1<<PORTE2) | (1<<PORTE1) | (1<<PORTE0);
-	DDRE = (1<<DDE2);
+	// Higher resistance value => lower motor current
+	if (args[0] < 1 || args[0] > RESISTANCE_LEVEL_COUNT)
+	{
+		return;
+	}
+	resistance_level = args[0];
+	set_ramp_time(resistance_levels[resistance_level - 1].ramp_ms);
+}
+
+static void cmd_query_overruns(const uint8_t* args)
+{
+	(void)args;
+	bt_send_tick_overruns(get_tick_overruns());
+}
+
+static void cmd_set_telemetry_mode(const uint8_t* args)
+{
+	// Select full snapshot (0) or compressed delta (1) telemetry
+	bt_set_compressed_telemetry(args[0] != 0);
+}
+
+static void cmd_set_stream_link(const uint8_t* args)
+{
+	// Route a stream (0 = protocol, 1 = debug) to a link (0 = Bluetooth, 1 = debug UART)
+	uart_set_stream_link(args[0], args[1]);
+}
+
+static void cmd_request_baud(const uint8_t* args)
+{
+	// Change a link (0 = Bluetooth, 1 = debug UART) to a new baud code
+	uart_request_baud(args[0], args[1]);
+}
+
+static void cmd_confirm_baud(const uint8_t* args)
+{
+	uart_confirm_baud(args[0]);
 }
 
-// Check if a finger is flexing. Returns 1 if it's more flexed than the previous iteration, -1 if it's less flexed, 0 if unchanged.
-int8_t check_finger_flexion(adc_readings_t *current, adc_readings_t *prev, potentiometer knuckle1, potentiometer knuckle2, potentiometer knuckle3)
+static void cmd_throughput_test(const uint8_t* args)
 {
-	if (current->potentiometers[knuckle1] >> POT_FILTER_SHIFT < prev->potentiometers[knuckle1] >> POT_FILTER_SHIFT || 
-		current->potentiometers[knuckle2] >> POT_FILTER_SHIFT < prev->potentiometers[knuckle2] >> POT_FILTER_SHIFT || 
-		current->potentiometers[knuckle3] >> POT_FILTER_SHIFT < prev->potentiometers[knuckle3] >> POT_FILTER_SHIFT)
+	// Run a throughput test on a link for a number of seconds
+	uart_start_throughput_test(args[0], args[1]);
+}
+
+static void cmd_query_profile(const uint8_t* args)
+{
+	// Dump every profiler page. A nonzero argument clears the stats afterwards so the next dump only covers what happens from then on.
+	profile_pages_pending = (1<<PROFILE_PAGE_COUNT) - 1;
+	profile_clear_pending = args[0] != 0;
+}
+
+static void cmd_set_flexion_thresholds(const uint8_t* args)
+{
+	// Set the flexion deadband and hysteresis, in 1/4096ths of a turn of total finger flexion
+	set_flexion_thresholds(args[0], args[1]);
+}
+
+static void cmd_set_ramp_time(const uint8_t* args)
+{
+	// Set the soft start/stop time of a resistance level, in ms
+	uint8_t level = args[0];
+	if (level < 1 || level > RESISTANCE_LEVEL_COUNT || args[1] == 0)
+	{
+		return;
+	}
+	resistance_levels[level - 1].ramp_ms = args[1];
+	if (level == resistance_level)
 	{
-		return 1;
+		set_ramp_time(args[1]);
 	}
-	else if (current->potentiometers[knuckle1] >> POT_FILTER_SHIFT > prev->potentiometers[knuckle1] >> POT_FILTER_SHIFT || 
-			 current->potentiometers[knuckle2] >> POT_FILTER_SHIFT > prev->potentiometers[knuckle2] >> POT_FILTER_SHIFT || 
-			 current->potentiometers[knuckle3] >> POT_FILTER_SHIFT > prev->potentiometers[knuckle3] >> POT_FILTER_SHIFT)
+}
+
+static void cmd_set_hold_time(const uint8_t* args)
+{
+	// Set how long a motor holds its direction once triggered, in ms (big-endian)
+	uint8_t motor_num = args[0];
+	uint16_t ms = ((uint16_t)args[1] << 8) | args[2];
+	if (motor_num >= MOTOR_COUNT || ms == 0)
 	{
-		return -1;
+		return;
 	}
-	return 0;
+	motor_hold_ms[motor_num] = ms;
+}
+
+static void cmd_set_filter(const uint8_t* args)
+{
+	// Set the filter pipeline for the pots (group 0) or motor currents (group 1): [group][median on][IIR shift][oversample shift]
+	filter_config_t config;
+	config.median = args[1] != 0;
+	config.iir_shift = args[2];
+	config.oversample_shift = args[3];
+	set_filter_config(args[0], &config);
+}
+
+static void cmd_query_spi_clock(const uint8_t* args)
+{
+	(void)args;
+	bt_send_spi_clock(get_spi_clock_divider());
 }
 
-ISR(TIMER3_OVF_vect)
+static void cmd_query_boot_time(const uint8_t* args)
+{
+	(void)args;
+	bt_send_boot_time(boot_ms, boot_settled);
+}
+
+// True if no motor is being driven. The motors follow the fingers whether or not an exercise has been started,
+// so this is what has to be checked before blocking the loop.
+static bool motors_idle(void)
 {
 	for (motor i = MOTOR_PINKY; i <= MOTOR_THUMB; i++)
 	{
-		if (motor_cycles_remaining[i] > 0)
+		if (motor_drive[i] != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static void cmd_calibrate(const uint8_t* args)
+{
+	// 0 cancels, 1 starts recording every pot's range, 2 takes the current positions as midpoints, 3 saves to EEPROM
+	// (refused while any motor is driven). Replies with an 0xAA frame either way.
+	int status;
+	switch (args[0])
+	{
+	case 0:
+		cancel_calibration();
+		status = 0;
+		break;
+	case 1:
+		start_calibration();
+		status = 0;
+		break;
+	case 2:
+		status = capture_calibration_midpoints();
+		break;
+	case 3:
+		// Writing the EEPROM blocks the loop for up to 0.3s, and nothing would update a driven motor's current meanwhile
+		status = motors_idle() ? save_calibration() : 1;
+		break;
+	default:
+		status = 1;
+		break;
+	}
+	bt_send_calibration_status(args[0], status == 0, calibration_valid());
+}
+
+static void cmd_set_telemetry_units(const uint8_t* args)
+{
+	// Send pots as raw readings (0) or joint angles (1), send finger poses instead (2), or send nothing periodic (3)
+	if (args[0] > TELEMETRY_OFF)
+	{
+		return;
+	}
+	telemetry = args[0];
+}
+
+static void cmd_stage_curve_point(const uint8_t* args)
+{
+	// Upload one point of a motor's resistance curve: [motor][index][flexion hi][flexion lo][current hi][current lo].
+	// Flexion is in 1/16384ths of a turn, current in IPROPI counts. Takes effect once the curve is applied with 0x96.
+	curve_point_t point;
+	point.flexion = (int16_t)(((uint16_t)args[2] << 8) | args[3]);
+	point.current = ((uint16_t)args[4] << 8) | args[5];
+	stage_curve_point(args[0], args[1], &point);
+}
+
+static void cmd_resistance_curve(const uint8_t* args)
+{
+	// [action][motor][count]: 0 replaces the motor's curve with the first count uploaded points (0 removes it, going back to
+	// the resistance level), 1 saves every curve to EEPROM (refused while any motor is driven), 2 reloads them from EEPROM.
+	// Replies with an 0xAD frame either way.
+	int status;
+	switch (args[0])
+	{
+	case 0:
+		status = apply_staged_curve(args[1], args[2]);
+		break;
+	case 1:
+		// Writing the EEPROM blocks the loop for up to 0.6s, so only while no motor is driven, like saving the calibration
+		status = motors_idle() ? 0 : 1;
+		if (status == 0)
 		{
-			motor_cycles_remaining[i]--;
+			save_resistance_curves();
 		}
+		break;
+	case 2:
+		status = load_resistance_curves();
+		break;
+	default:
+		status = 1;
+		break;
 	}
+	bt_send_curve_status(args[0], args[1], status == 0);
+}
+
+void setup_gpio(void)
+{
+	// PORTxn : If port x, pin n is input: 1 enables internal pull-up. If port x, pin n is output: sets value of port.
+	// DDxn : Data Direction, Port x, Pin n. 1 = Output, 0 = Input
+	PORTB = (1<<PORTB7) | (1<<PORTB6);
+	DDRB = (1<<DDB0);
+	
+	PORTC = (1<<PORTC5) | (1<<PORTC3) | (1<<PORTC2);
+	DDRC = (1<<DDC5) | (1<<DDC4) | (1<<DDC3) | (1<<DDC2);
+	
+	PORTD = (1<<PORTD4);
+	DDRD = (1<<DDD7) | (1<<DDD2);
+	
+	PORTE = (1<<PORTE2) | (1<<PORTE1) | (1<<PORTE0);
+	DDRE = (1<<DDE2);
 }
@@ -7,15 +7,43 @@
 
 #include "motor.h"
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
 #include <stdbool.h>
 
+#include "hal.h"
 #include "uart.h"
+#include "profiler.h"
 
 // ISR will set this so we can handle notifying the application in the main loop
 volatile bool motor_faulted[MOTOR_COUNT];
 
+// Ports holding the phase pins
+#define PHASE_PORT_C 0
+#define PHASE_PORT_D 1
+#define PHASE_PORT_COUNT 2
+static volatile uint8_t* const phase_ports[PHASE_PORT_COUNT] = { &PORTC, &PORTD };
+// Every phase pin on each port, so the other pins on the port are left alone
+static const uint8_t phase_port_masks[PHASE_PORT_COUNT] = { 1<<PORTC4, (1<<PORTD7) | (1<<PORTD2) };
+
+typedef struct
+{
+	volatile uint8_t* ocr;		// Output compare register setting the duty cycle
+	uint8_t phase_port;			// Index into phase_ports
+	uint8_t phase_mask;			// Phase pin on that port
+	uint8_t phase_pin;			// The same for every motor on that pin, 0 to MOTOR_PHASE_PIN_COUNT - 1
+} motor_output_t;
+
+// Where each motor is wired, indexed by motor. Entries sharing a phase pin are listed so the later one wins in apply_motor_frame().
+// TC1 runs in 8 bit mode so only the low byte of OCR1A/B is written. The high byte comes from the shared TEMP register,
+// which stays 0 since nothing else writes a high byte of a TC1 register after setup.
+static const motor_output_t motor_outputs[MOTOR_COUNT] =
+{
+	[MOTOR_PINKY] = { &OCR2B, PHASE_PORT_D, 1<<PORTD7, 0 },
+	[MOTOR_RING] = { &OCR1BL, PHASE_PORT_D, 1<<PORTD7, 0 },
+	[MOTOR_MIDDLE] = { &OCR1AL, PHASE_PORT_C, 1<<PORTC4, 1 },
+	[MOTOR_INDEX] = { &OCR0B, PHASE_PORT_C, 1<<PORTC4, 1 },
+	[MOTOR_THUMB] = { &OCR0A, PHASE_PORT_D, 1<<PORTD2, 2 },
+};
+
 void setup_motors(void)
 {
 	// N.B. The different hardware counters have different capabilities and configuration methods.
@@ -61,83 +89,35 @@ void setup_motors(void)
 
 int set_motor_speed(motor motor_num, uint8_t duty)
 {
-	switch (motor_num)
+	if (motor_num >= MOTOR_COUNT)
 	{
-		case MOTOR_THUMB:
-			OCR0A = duty;
-			break;
-		case MOTOR_INDEX:
-			OCR0B = duty;
-			break;
-		case MOTOR_MIDDLE:
-			OCR1A = duty;
-			break;
-		case MOTOR_RING:
-			OCR1B = duty;
-			break;
-		case MOTOR_PINKY:
-			OCR2B = duty;
-			break;
-		default:
-			return 1;
+		return 1;
 	}
+	
+	*motor_outputs[motor_num].ocr = duty;
 	return 0;
 }
 
-// This is ugly but I don't know a better way to do it!!
 int set_motor_phase(motor motor_num, motor_direction direction)
 {
-	// Get the current value of the register containing the bit to change
-	uint8_t current_value;
-	uint8_t mask;
-	switch (motor_num)
+	if (motor_num >= MOTOR_COUNT || (direction != DIRECTION_FORWARD && direction != DIRECTION_BACKWARD))
 	{
-		case MOTOR_THUMB:
-			current_value = PORTD;
-			mask = 1<<PORTD2;
-			break;
-		case MOTOR_INDEX:
-		case MOTOR_MIDDLE:
-			current_value = PORTC;
-			mask = 1<<PORTC4;
-			break;
-		case MOTOR_RING:
-		case MOTOR_PINKY:
-			current_value = PORTD;
-			mask = 1<<PORTD7;
-			break;
-		default:
-			return 1;
+		return 1;
 	}
 	
 	// Motor has forward direction if PH = 1, backwards if PH = 0
-	uint8_t new_value;
-	switch (direction)
-	{
-		case DIRECTION_FORWARD:
-			new_value = current_value | mask;
-			break;
-		case DIRECTION_BACKWARD:
-			new_value = current_value & ~mask;
-			break;
-		default:
-			return 1;
-	}
-	
-	// Set the new value
-	switch (motor_num)
+	const motor_output_t* output = &motor_outputs[motor_num];
+	volatile uint8_t* port = phase_ports[output->phase_port];
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
 	{
-		case MOTOR_THUMB:
-		case MOTOR_RING:
-		case MOTOR_PINKY:
-			PORTD = new_value;
-			break;
-		case MOTOR_INDEX:
-		case MOTOR_MIDDLE:
-			PORTC = new_value;
-			break;
-		default:
-			return 1;
+		if (direction == DIRECTION_FORWARD)
+		{
+			*port |= output->phase_mask;
+		}
+		else
+		{
+			*port &= ~output->phase_mask;
+		}
 	}
 	return 0;
 }
@@ -151,15 +131,75 @@ int set_motor_enable(uint8_t state)
 	
 	uint8_t mask = 1<<PORTB0;
 	uint8_t new_bit = state<<PORTB0;
-	uint8_t current = PORTB;
 	
-	PORTB = (current & ~mask) | (new_bit & mask);
+	// The fault ISRs also write PORTB
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		PORTB = (PORTB & ~mask) | (new_bit & mask);
+	}
 	
 	return 0;
 }
 
+uint8_t get_motor_phase_pin(motor motor_num)
+{
+	return motor_outputs[motor_num].phase_pin;
+}
+
+int apply_motor_frame(const motor_frame_t* frame)
+{
+	// Each phase pin follows the later of its motors, except that a stopped motor never overrides a driven one
+	uint8_t phase_bits[PHASE_PORT_COUNT] = { 0 };
+	uint8_t driven_pins[PHASE_PORT_COUNT] = { 0 };
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		const motor_output_t* output = &motor_outputs[i];
+		if (frame->duty[i] != 0)
+		{
+			driven_pins[output->phase_port] |= output->phase_mask;
+		}
+		else if (driven_pins[output->phase_port] & output->phase_mask)
+		{
+			continue;
+		}
+		if (frame->direction[i] == DIRECTION_FORWARD)
+		{
+			phase_bits[output->phase_port] |= output->phase_mask;
+		}
+		else
+		{
+			phase_bits[output->phase_port] &= ~output->phase_mask;
+		}
+	}
+	
+	// A driven motor whose pin was set the other way by its partner would run backwards, so stop it instead
+	int result = 0;
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		const motor_output_t* output = &motor_outputs[i];
+		uint8_t duty = frame->duty[i];
+		bool forward = phase_bits[output->phase_port] & output->phase_mask;
+		if (duty != 0 && forward != (frame->direction[i] == DIRECTION_FORWARD))
+		{
+			duty = 0;
+			result = 1;
+		}
+		*output->ocr = duty;
+	}
+	
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		for (uint8_t p = 0; p < PHASE_PORT_COUNT; p++)
+		{
+			*phase_ports[p] = (*phase_ports[p] & ~phase_port_masks[p]) | phase_bits[p];
+		}
+	}
+	return result;
+}
+
 ISR(PCINT3_vect)
 {
+	uint16_t start = profile_now_irq_off();
 	if (!(PORTE & (1<<PORTE0)))
 	{
 		set_motor_enable(0);
@@ -170,19 +210,23 @@ ISR(PCINT3_vect)
 		set_motor_enable(0);
 		motor_faulted[MOTOR_RING] = true;
 	}
+	profile_record_isr(PROFILE_ISR_PCINT3, start);
 }
 
 ISR(PCINT2_vect)
 {
+	uint16_t start = profile_now_irq_off();
 	if (!(PORTD & (1<<PORTD4)))
 	{
 		set_motor_enable(0);
 		motor_faulted[MOTOR_PINKY] = true;
 	}
+	profile_record_isr(PROFILE_ISR_PCINT2, start);
 }
 
 ISR(PCINT0_vect)
 {
+	uint16_t start = profile_now_irq_off();
 	if (!(PORTB & (1<<PORTB6)))
 	{
 		set_motor_enable(0);
@@ -193,4 +237,5 @@ ISR(PCINT0_vect)
 		set_motor_enable(0);
 		motor_faulted[MOTOR_INDEX] = true;
 	}
+	profile_record_isr(PROFILE_ISR_PCINT0, start);
 }
\ No newline at end of file
@@ -15,6 +15,16 @@
 
 #define MOTOR_COUNT 5
 
+// Number of phase pins. Index and middle share one, as do ring and pinky, so motors on the same pin always turn the same way.
+#define MOTOR_PHASE_PIN_COUNT 3
+
+// Everything driven on the motors at one moment, indexed by motor
+typedef struct
+{
+	uint8_t duty[MOTOR_COUNT];
+	motor_direction direction[MOTOR_COUNT];
+} motor_frame_t;
+
 void setup_motors(void);
 
 int set_motor_speed(motor motor_num, uint8_t duty);
@@ -23,4 +33,27 @@ int set_motor_phase(motor motor_num, motor_direction direction);
 
 int set_motor_enable(uint8_t state);
 
+/**
+ * \brief Returns which phase pin sets a motor's direction. Motors that return the same pin can't be driven in opposite directions.
+ * 
+ * \param motor_num The motor, less than MOTOR_COUNT.
+ * 
+ * \return uint8_t The pin, 0 to MOTOR_PHASE_PIN_COUNT - 1.
+ */
+uint8_t get_motor_phase_pin(motor motor_num);
+
+/**
+ * \brief Drives every motor at once. All the output compares are written back to back, then the phase pins are updated
+ * with a single write per port inside a short critical section, so the motors change together and the pins can't be
+ * corrupted by an interrupt.
+ * N.B. Index and middle share one phase pin, as do ring and pinky (see get_motor_phase_pin()). A pin is set by the motors
+ * on it with a nonzero duty, or by index and ring if neither motor of the pair is driven. If both are driven in opposite
+ * directions, index and ring win and the other motor of the pair is stopped rather than driven against its commanded direction.
+ * 
+ * \param frame The duty and direction of every motor.
+ * 
+ * \return int 0 if the frame was applied as given. Nonzero indicates a pair disagreed and a motor was stopped.
+ */
+int apply_motor_frame(const motor_frame_t* frame);
+
 #endif /* MOTOR_H_ */
\ No newline at end of file
@@ -0,0 +1,229 @@
+/*
+ * motor_ramp.c
+ *
+ * Created: 2026-10-17
+ */
+
+#include "motor_ramp.h"
+
+#include <stdbool.h>
+
+#include "hal.h"
+#include "motor.h"
+#include "soft_timer.h"
+
+// Ramp progress once the output has reached the end of the ramp
+#define RAMP_DONE 0xFFFF
+
+// Fraction of the way from the start to the end of a ramp after each step, out of 255.
+// Speeding up follows an S-curve so the current rises gently at both ends.
+static const uint8_t accel_profile[RAMP_TABLE_LEN] PROGMEM =
+{
+	1, 3, 6, 11, 17, 24, 31, 40, 49, 59, 70, 81, 92, 104, 116, 128,
+	139, 151, 163, 174, 185, 196, 206, 215, 224, 231, 238, 244, 249, 252, 254, 255
+};
+// Slowing down starts slowly, while the motor is fast and its back-EMF is largest, and finishes quickly
+static const uint8_t decel_profile[RAMP_TABLE_LEN] PROGMEM =
+{
+	0, 1, 2, 4, 6, 9, 12, 16, 20, 25, 30, 36, 42, 49, 56, 64,
+	72, 81, 90, 100, 110, 121, 132, 143, 156, 168, 182, 195, 209, 224, 239, 255
+};
+
+typedef struct
+{
+	uint8_t duty;					// Output currently set
+	uint8_t from;					// Duty at the start of the current ramp
+	uint8_t to;						// Duty at the end of the current ramp
+	uint16_t pos;					// Progress through the profile with 8 fractional bits, or RAMP_DONE
+	const uint8_t* profile;
+} ramp_t;
+
+// Written by the main loop, read by the ISR. Each is a single byte so no locking is needed.
+static volatile uint8_t target_duty[MOTOR_COUNT];
+static volatile motor_direction target_direction[MOTOR_COUNT];
+// Only touched by the ISR
+static ramp_t ramps[MOTOR_COUNT];
+// Direction each phase pin is currently set to. Motors sharing a pin share this.
+static motor_direction pin_directions[MOTOR_PHASE_PIN_COUNT];
+// Profile steps per ramp step, with 8 fractional bits
+static volatile uint16_t ramp_increment = ((uint16_t)RAMP_TABLE_LEN << 8) / RAMP_DEFAULT_MS;
+
+static void step_motor_ramps(void);
+
+void setup_motor_ramps(void)
+{
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		target_duty[i] = 0;
+		target_direction[i] = DIRECTION_BACKWARD;
+		ramps[i].duty = 0;
+		ramps[i].pos = RAMP_DONE;
+	}
+	// The phase pins start low
+	for (uint8_t p = 0; p < MOTOR_PHASE_PIN_COUNT; p++)
+	{
+		pin_directions[p] = DIRECTION_BACKWARD;
+	}
+
+	set_timer_callback(TIMER_MOTOR_RAMP, step_motor_ramps);
+	start_timer(TIMER_MOTOR_RAMP, RAMP_STEP_MS, RAMP_STEP_MS);
+}
+
+int set_ramp_time(uint8_t ms)
+{
+	if (ms == 0)
+	{
+		return 1;
+	}
+
+	ramp_increment = ((uint16_t)RAMP_TABLE_LEN << 8) / ms;
+	return 0;
+}
+
+int set_motor_target(motor motor_num, motor_direction direction, uint8_t duty)
+{
+	if (motor_num >= MOTOR_COUNT)
+	{
+		return 1;
+	}
+
+	target_direction[motor_num] = direction;
+	target_duty[motor_num] = duty;
+	return 0;
+}
+
+static inline uint8_t duty_distance(uint8_t a, uint8_t b)
+{
+	return a > b ? a - b : b - a;
+}
+
+static void start_ramp(ramp_t* ramp, uint8_t to)
+{
+	ramp->from = ramp->duty;
+	ramp->to = to;
+	ramp->pos = 0;
+	ramp->profile = to > ramp->duty ? accel_profile : decel_profile;
+}
+
+// Moves one motor's output a step towards a duty. Returns true if the output changed.
+static bool step_ramp(ramp_t* ramp, uint8_t target)
+{
+	if (ramp->pos == RAMP_DONE)
+	{
+		if (target == ramp->duty)
+		{
+			return false;
+		}
+		if (duty_distance(target, ramp->duty) <= RAMP_BYPASS_STEP)
+		{
+			ramp->duty = target;
+			return true;
+		}
+		start_ramp(ramp, target);
+	}
+	else if (target != ramp->to)
+	{
+		// Nudging the end point of a ramp in progress keeps its shape. A bigger change starts a new ramp from here.
+		if (duty_distance(target, ramp->to) <= RAMP_BYPASS_STEP)
+		{
+			ramp->to = target;
+		}
+		else
+		{
+			start_ramp(ramp, target);
+		}
+	}
+
+	ramp->pos += ramp_increment;
+	if (ramp->pos >= ((uint16_t)RAMP_TABLE_LEN << 8))
+	{
+		ramp->duty = ramp->to;
+		ramp->pos = RAMP_DONE;
+	}
+	else
+	{
+		uint8_t fraction = pgm_read_byte(&ramp->profile[ramp->pos >> 8]);
+		if (ramp->to > ramp->from)
+		{
+			ramp->duty = ramp->from + (uint8_t)(((uint16_t)(ramp->to - ramp->from) * fraction) >> 8);
+		}
+		else
+		{
+			ramp->duty = ramp->from - (uint8_t)(((uint16_t)(ramp->from - ramp->to) * fraction) >> 8);
+		}
+	}
+	return true;
+}
+
+// Runs from the soft timer tick every RAMP_STEP_MS
+static void step_motor_ramps(void)
+{
+	uint8_t targets[MOTOR_COUNT];
+	motor_direction directions[MOTOR_COUNT];
+	// Which way each phase pin should point. When both motors on a pin are driven in opposite directions the later one in
+	// motor order wins (index over middle, ring over pinky), the same as apply_motor_frame(). An undriven pin stays put.
+	motor_direction wanted[MOTOR_PHASE_PIN_COUNT];
+	// Bit p set while any motor on pin p still has some output
+	uint8_t loaded_pins = 0;
+	for (uint8_t p = 0; p < MOTOR_PHASE_PIN_COUNT; p++)
+	{
+		wanted[p] = pin_directions[p];
+	}
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		uint8_t pin = get_motor_phase_pin(i);
+		targets[i] = target_duty[i];
+		directions[i] = target_direction[i];
+		if (targets[i] != 0)
+		{
+			wanted[pin] = directions[i];
+		}
+		if (ramps[i].duty != 0)
+		{
+			loaded_pins |= (1<<pin);
+		}
+	}
+	
+	// Never switch phase under load. A pin only switches once every motor on it has ramped down to 0,
+	// since switching it reverses all of them.
+	bool changed = false;
+	uint8_t switching_pins = 0;
+	for (uint8_t p = 0; p < MOTOR_PHASE_PIN_COUNT; p++)
+	{
+		if (wanted[p] != pin_directions[p])
+		{
+			switching_pins |= (1<<p);
+			if (!(loaded_pins & (1<<p)))
+			{
+				pin_directions[p] = wanted[p];
+				changed = true;
+			}
+		}
+	}
+	
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		uint8_t pin = get_motor_phase_pin(i);
+		uint8_t target = targets[i];
+		// Ramp down every motor on a pin that is switching, and hold it at 0 for the step the pin switches on.
+		// A motor that lost its pin to the other direction stays stopped.
+		if ((switching_pins & (1<<pin)) || directions[i] != pin_directions[pin])
+		{
+			target = 0;
+		}
+		changed |= step_ramp(&ramps[i], target);
+	}
+	
+	// Every motor changes at the same moment
+	if (changed)
+	{
+		motor_frame_t frame;
+		for (motor i = 0; i < MOTOR_COUNT; i++)
+		{
+			frame.duty[i] = ramps[i].duty;
+			frame.direction[i] = pin_directions[get_motor_phase_pin(i)];
+		}
+		// Motors sharing a pin always agree here, so the frame is never cut short
+		apply_motor_frame(&frame);
+	}
+}
@@ -0,0 +1,59 @@
+/*
+ * motor_ramp.h
+ *
+ * Created: 2026-10-17
+ */
+
+
+#ifndef MOTOR_RAMP_H_
+#define MOTOR_RAMP_H_
+
+#include <stdint.h>
+
+#include "glove_enums.h"
+
+// The ramps advance on a periodic soft timer with this period
+#define RAMP_STEP_MS 1
+
+// Number of steps in each profile table
+#define RAMP_TABLE_LEN 32
+
+// Duty changes up to this size are applied straight away instead of ramped, so small corrections from the current controller aren't slowed down
+#define RAMP_BYPASS_STEP 16
+
+#define RAMP_DEFAULT_MS 40
+
+/**
+ * \brief Starts the periodic ramp timer. setup_soft_timers() must be called first.
+ * All motors start stopped, in the direction the phase pins were left in by setup_gpio().
+ *
+ * \return void
+ */
+void setup_motor_ramps(void);
+
+/**
+ * \brief Sets how long every following ramp takes, regardless of how far it goes.
+ *
+ * \param ms Ramp time in milliseconds, 1 to 255.
+ *
+ * \return int 0 if the operation was successful. Nonzero indicates an argument out of range.
+ */
+int set_ramp_time(uint8_t ms);
+
+/**
+ * \brief Sets the duty and direction a motor should reach. The ramp timer moves the output there along the
+ * acceleration profile when speeding up, or the deceleration profile when slowing down. Reversing ramps down to 0 before
+ * switching phase, then ramps back up. Cheap enough to call every control tick.
+ * Motors sharing a phase pin (see get_motor_phase_pin()) are reversed together, so both ramp down before the pin switches.
+ * If both are driven in opposite directions, the later one in motor order (index over middle, ring over pinky) gets the pin
+ * and the other is held at 0 until it asks for the same direction or stops.
+ *
+ * \param motor_num The motor to drive.
+ * \param direction Direction to drive in. Ignored when duty is 0.
+ * \param duty Target duty cycle for set_motor_speed().
+ *
+ * \return int 0 if the operation was successful. Nonzero indicates an invalid motor.
+ */
+int set_motor_target(motor motor_num, motor_direction direction, uint8_t duty);
+
+#endif /* MOTOR_RAMP_H_ */
@@ -0,0 +1,128 @@
+/*
+ * profiler.c
+ *
+ * Created: 2026-10-17
+ */
+
+#include "profiler.h"
+
+#include "soft_timer.h"
+
+typedef struct
+{
+	uint16_t min;
+	uint16_t max;
+	uint32_t total;
+	uint16_t count;
+} profile_stats_t;
+
+static volatile profile_stats_t stats[PROFILE_SLOT_COUNT];
+static volatile uint16_t irq_off_max;
+
+uint32_t profile_now(void)
+{
+	return timer_cycles();
+}
+
+static void add_measurement(profile_slot slot, uint16_t cycles)
+{
+	volatile profile_stats_t *s = &stats[slot];
+
+	// Halve the history instead of letting the total overflow, so the mean follows recent behaviour
+	if (s->count == UINT16_MAX)
+	{
+		s->total >>= 1;
+		s->count >>= 1;
+	}
+	if (s->count == 0 || cycles < s->min) s->min = cycles;
+	if (cycles > s->max) s->max = cycles;
+	s->total += cycles;
+	s->count++;
+}
+
+void profile_record(profile_slot slot, uint32_t start)
+{
+	uint32_t cycles = profile_now() - start;
+	add_measurement(slot, cycles < PROFILE_SATURATED ? (uint16_t)cycles : PROFILE_SATURATED);
+}
+
+void profile_record_isr(profile_slot slot, uint16_t start)
+{
+	uint16_t cycles = profile_now_irq_off() - start;
+	add_measurement(slot, cycles);
+	if (cycles > irq_off_max)
+	{
+		irq_off_max = cycles;
+	}
+}
+
+void profile_irq_off(uint16_t start)
+{
+	uint16_t cycles = profile_now_irq_off() - start;
+	if (cycles > irq_off_max)
+	{
+		irq_off_max = cycles;
+	}
+}
+
+uint8_t get_profile_page(uint8_t page, profile_slot *first)
+{
+	if (page >= PROFILE_PAGE_COUNT)
+	{
+		return 0;
+	}
+	if (page == 0)
+	{
+		*first = PROFILE_LOOP;
+		return PROFILE_FIRST_ISR;
+	}
+
+	uint8_t start = PROFILE_FIRST_ISR + (page - 1) * PROFILE_MAX_PAGE_SLOTS;
+	uint8_t remaining = PROFILE_SLOT_COUNT - start;
+	*first = (profile_slot)start;
+	return remaining < PROFILE_MAX_PAGE_SLOTS ? remaining : PROFILE_MAX_PAGE_SLOTS;
+}
+
+int get_profile_summary(profile_slot slot, profile_summary_t *dest)
+{
+	if (slot >= PROFILE_SLOT_COUNT)
+	{
+		return 1;
+	}
+
+	uint32_t total;
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		dest->min = stats[slot].min;
+		dest->max = stats[slot].max;
+		dest->count = stats[slot].count;
+		total = stats[slot].total;
+	}
+	dest->mean = dest->count ? (uint16_t)(total / dest->count) : 0;
+	return 0;
+}
+
+uint16_t get_profile_irq_off_max(void)
+{
+	uint16_t max;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		max = irq_off_max;
+	}
+	return max;
+}
+
+void clear_profile(void)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		for (uint8_t i = 0; i < PROFILE_SLOT_COUNT; i++)
+		{
+			stats[i].min = 0;
+			stats[i].max = 0;
+			stats[i].total = 0;
+			stats[i].count = 0;
+		}
+		irq_off_max = 0;
+	}
+}
@@ -0,0 +1,156 @@
+/*
+ * profiler.h
+ *
+ * Created: 2026-10-17
+ */
+
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdint.h>
+
+#include "hal.h"
+
+// Everything that gets timed. The loop phases share their numbering with tick_phase, with slot 0 used for the whole
+// busy part of an iteration (tick to going back to idle) since nothing is timed while idle.
+typedef enum
+{
+	PROFILE_LOOP = 0,
+	PROFILE_ACQUIRE = 1,
+	PROFILE_FILTER = 2,
+	PROFILE_DECIDE = 3,
+	PROFILE_ACTUATE = 4,
+	PROFILE_REPORT = 5,
+	PROFILE_ISR_SPI1 = 6,
+	PROFILE_ISR_TICK = 7,
+	PROFILE_ISR_SOFT_TIMER = 8,
+	PROFILE_ISR_USART0_RX = 9,
+	PROFILE_ISR_USART0_UDRE = 10,
+	PROFILE_ISR_USART1_RX = 11,
+	PROFILE_ISR_USART1_UDRE = 12,
+	PROFILE_ISR_PCINT0 = 13,
+	PROFILE_ISR_PCINT2 = 14,
+	PROFILE_ISR_PCINT3 = 15
+} profile_slot;
+
+#define PROFILE_SLOT_COUNT 16
+// Slots from here on are ISRs, which run with interrupts off
+#define PROFILE_FIRST_ISR PROFILE_ISR_SPI1
+
+// The slots are reported in pages so each frame fits in the send buffer: page 0 is the loop, the rest are the ISRs
+// in order, up to PROFILE_MAX_PAGE_SLOTS each. The loop has to fit on one page.
+#define PROFILE_MAX_PAGE_SLOTS 6
+#define PROFILE_PAGE_COUNT (1 + (PROFILE_SLOT_COUNT - PROFILE_FIRST_ISR + PROFILE_MAX_PAGE_SLOTS - 1) / PROFILE_MAX_PAGE_SLOTS)
+
+// Main loop measurements this long or longer are recorded as this, so a max of UINT16_MAX means at least 8.2ms
+#define PROFILE_SATURATED UINT16_MAX
+
+typedef struct
+{
+	uint16_t min;
+	uint16_t max;
+	uint16_t mean;
+	uint16_t count;
+} profile_summary_t;
+
+/**
+ * \brief Returns the timer 3 count, for timing ISRs and critical sections. Timer 3 runs at clk/1 (see main), so one count is one CPU cycle.
+ * Only call this with interrupts disabled: the soft timer ISR writes OCR3A, which shares the temporary high byte register
+ * with TCNT3, so an interrupt between the two halves of the read would corrupt it.
+ * Differences between two counts are correct as long as less than 65536 cycles (8.2ms) pass between them.
+ *
+ * \return uint16_t The current count.
+ */
+static inline uint16_t profile_now_irq_off(void)
+{
+	return TCNT3;
+}
+
+/**
+ * \brief Returns a timestamp for timing main loop sections, which can be interrupted and can take longer than timer 3 takes to wrap.
+ * This is timer_cycles(), the timer 3 count extended by the soft timer tick, so setup_soft_timers() must have been called.
+ * Differences between two timestamps are correct for about 9 minutes.
+ *
+ * \return uint32_t The current timestamp in cycles.
+ */
+uint32_t profile_now(void);
+
+/**
+ * \brief Adds one measurement to a main loop slot. Measurements of PROFILE_SATURATED cycles or longer are recorded as PROFILE_SATURATED.
+ *
+ * \param slot The slot being measured, below PROFILE_FIRST_ISR.
+ * \param start The profile_now() timestamp taken at the start of the measured section.
+ *
+ * \return void
+ */
+void profile_record(profile_slot slot, uint32_t start);
+
+/**
+ * \brief Adds one measurement to an ISR slot, which also counts towards the interrupt-off high-water mark. Call at the end of the ISR.
+ *
+ * \param slot The slot being measured, PROFILE_FIRST_ISR or above.
+ * \param start The profile_now_irq_off() count taken at the start of the ISR.
+ *
+ * \return void
+ */
+void profile_record_isr(profile_slot slot, uint16_t start);
+
+/**
+ * \brief Works out which slots are on a page of the report.
+ *
+ * \param page The page, 0 to PROFILE_PAGE_COUNT - 1.
+ * \param first Set to the first slot on the page.
+ *
+ * \return uint8_t The number of slots on the page, up to PROFILE_MAX_PAGE_SLOTS. 0 if the page is invalid.
+ */
+uint8_t get_profile_page(uint8_t page, profile_slot *first);
+
+/**
+ * \brief Adds a section that ran with interrupts disabled to the interrupt-off high-water mark.
+ * Must be called with interrupts still disabled.
+ *
+ * \param start The profile_now_irq_off() count taken right after interrupts were disabled.
+ *
+ * \return void
+ */
+void profile_irq_off(uint16_t start);
+
+// Cleanup handler for PROFILED_ATOMIC_BLOCK(), so the section is recorded however the block is left
+static inline void profile_irq_off_cleanup(const uint16_t *start)
+{
+	profile_irq_off(*start);
+}
+
+// Drop-in replacement for ATOMIC_BLOCK() that adds the time interrupts were off to the interrupt-off high-water mark.
+// Use it for every critical section outside an ISR so the reported worst case covers them too.
+#define PROFILED_ATOMIC_BLOCK(type) \
+	ATOMIC_BLOCK(type) \
+	for (uint16_t profile_atomic_start_ __attribute__((__cleanup__(profile_irq_off_cleanup))) = profile_now_irq_off(), \
+		profile_atomic_once_ = 1; profile_atomic_once_; profile_atomic_once_ = 0)
+
+/**
+ * \brief Copies out the statistics for one slot. Cycles spent in ISRs that interrupt a main loop measurement are included in it.
+ *
+ * \param slot The slot to query.
+ * \param dest The summary to fill in. The mean is over the last 32768 to 65535 measurements.
+ *
+ * \return int 0 if the operation was successful. Nonzero indicates an invalid slot.
+ */
+int get_profile_summary(profile_slot slot, profile_summary_t *dest);
+
+/**
+ * \brief Returns the longest time interrupts have been disabled by an ISR or a profiled critical section.
+ *
+ * \return uint16_t The high-water mark in cycles.
+ */
+uint16_t get_profile_irq_off_max(void);
+
+/**
+ * \brief Clears every slot and the interrupt-off high-water mark.
+ *
+ * \return void
+ */
+void clear_profile(void);
+
+#endif /* PROFILER_H_ */
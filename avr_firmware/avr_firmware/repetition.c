@@ -0,0 +1,146 @@
+/*
+ * repetition.c
+ *
+ * Created: 2026-10-17
+ */
+
+#include "repetition.h"
+
+#include "motor.h"
+
+typedef struct
+{
+	bool flexing;				// Between starting a rep and completing it
+	int16_t start;				// Lowest flexion since the last rep, where the next rep is measured from
+	int16_t peak;				// Highest flexion of the rep in progress
+	uint16_t last_ms;			// Timestamp of the previous update
+	uint32_t elapsed_ms;		// Time since the finger was at start
+	uint32_t resisted_ms;		// Part of elapsed_ms the motor was driven
+	uint16_t count;
+} rep_tracker_t;
+
+static rep_tracker_t trackers[MOTOR_COUNT];
+static bool primed;
+
+static rep_summary_t queue[REP_QUEUE_LEN];
+static uint8_t queue_head;
+static uint8_t queue_count;
+
+static inline uint16_t saturate_ms(uint32_t ms)
+{
+	return ms > UINT16_MAX ? UINT16_MAX : (uint16_t)ms;
+}
+
+void reset_repetitions(void)
+{
+	primed = false;
+	queue_head = 0;
+	queue_count = 0;
+}
+
+// Starts looking for a new rep from where the finger is now
+static void restart_tracker(rep_tracker_t *tracker, int16_t flexion)
+{
+	tracker->flexing = false;
+	tracker->start = flexion;
+	tracker->elapsed_ms = 0;
+	tracker->resisted_ms = 0;
+}
+
+static void complete_rep(motor finger, rep_tracker_t *tracker)
+{
+	tracker->count++;
+	if (queue_count == REP_QUEUE_LEN)
+	{
+		return;
+	}
+
+	rep_summary_t *rep = &queue[(queue_head + queue_count) % REP_QUEUE_LEN];
+	rep->finger = finger;
+	rep->number = tracker->count;
+	rep->rom = tracker->peak - tracker->start;
+	rep->peak = tracker->peak;
+	rep->duration_ms = saturate_ms(tracker->elapsed_ms);
+	rep->resisted_ms = saturate_ms(tracker->resisted_ms);
+	queue_count++;
+}
+
+void update_repetitions(const finger_pose_t *poses, uint8_t resisted_mask, uint16_t now_ms)
+{
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		rep_tracker_t *tracker = &trackers[i];
+		int16_t flexion = poses[i].flexion;
+		if (!primed)
+		{
+			tracker->count = 0;
+			tracker->last_ms = now_ms;
+			restart_tracker(tracker, flexion);
+			continue;
+		}
+
+		// Timestamps are only 16 bits, so time is added up between updates instead of measured from the start of a rep
+		uint16_t elapsed = now_ms - tracker->last_ms;
+		tracker->last_ms = now_ms;
+		tracker->elapsed_ms += elapsed;
+		if (resisted_mask & (1<<i))
+		{
+			tracker->resisted_ms += elapsed;
+		}
+
+		if (!tracker->flexing)
+		{
+			// Keep moving the start down while the finger extends further, so a rep is measured from its lowest point
+			if (flexion < tracker->start)
+			{
+				restart_tracker(tracker, flexion);
+			}
+			else if (flexion - tracker->start <= REP_MIN_ROM >> REP_RETURN_SHIFT)
+			{
+				// Still resting, so the rep's clock only starts once the finger leaves
+				tracker->elapsed_ms = 0;
+				tracker->resisted_ms = 0;
+			}
+			else if (flexion - tracker->start >= REP_MIN_ROM)
+			{
+				tracker->flexing = true;
+				tracker->peak = flexion;
+			}
+		}
+		else
+		{
+			if (flexion > tracker->peak)
+			{
+				tracker->peak = flexion;
+			}
+			else if (flexion - tracker->start <= (tracker->peak - tracker->start) >> REP_RETURN_SHIFT)
+			{
+				complete_rep(i, tracker);
+				restart_tracker(tracker, flexion);
+			}
+		}
+	}
+	primed = true;
+}
+
+bool peek_repetition(rep_summary_t *dest)
+{
+	if (queue_count == 0)
+	{
+		return false;
+	}
+
+	*dest = queue[queue_head];
+	return true;
+}
+
+void pop_repetition(void)
+{
+	if (queue_count == 0)
+	{
+		return;
+	}
+
+	queue_head = (queue_head + 1) % REP_QUEUE_LEN;
+	queue_count--;
+}
@@ -0,0 +1,72 @@
+/*
+ * repetition.h
+ *
+ * Created: 2026-10-17
+ */
+
+
+#ifndef REPETITION_H_
+#define REPETITION_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "glove_enums.h"
+#include "kinematics.h"
+
+// Smallest change of total flexion, in KIN_TURN units, that counts as a flex. Smaller wobbles are ignored. About 15 degrees.
+#define REP_MIN_ROM (KIN_TURN / 24)
+
+// A rep is complete once the finger has come back down to within this fraction of its range from where the rep started, as a shift (1/4)
+#define REP_RETURN_SHIFT 2
+
+// Completed reps waiting to be sent. A rep that completes while this is full isn't queued, but still counts towards the rep numbers.
+#define REP_QUEUE_LEN 8
+
+typedef struct
+{
+	motor finger;
+	uint16_t number;			// Reps the finger has completed since the last reset, including this one
+	int16_t rom;				// Peak minus starting flexion, in KIN_TURN units
+	int16_t peak;				// Most flexed the finger got, in KIN_TURN units
+	uint16_t duration_ms;		// From leaving the extended position to coming back, saturated at 65535
+	uint16_t resisted_ms;		// Part of the duration the finger's motor was driven, saturated at 65535
+} rep_summary_t;
+
+/**
+ * \brief Forgets every finger's progress, rep counts and any reps not sent yet. The next update starts each finger extended
+ * wherever it is.
+ *
+ * \return void
+ */
+void reset_repetitions(void);
+
+/**
+ * \brief Advances every finger's rep tracking with a new scan. A finger starts a rep once it flexes REP_MIN_ROM past the
+ * lowest point since its last rep, and completes it once it has extended most of the way back.
+ *
+ * \param poses Array of MOTOR_COUNT finger poses from the latest scan, indexed by motor.
+ * \param resisted_mask Bit n set if motor n was driven since the previous update.
+ * \param now_ms Timestamp of the scan from timer_now().
+ *
+ * \return void
+ */
+void update_repetitions(const finger_pose_t *poses, uint8_t resisted_mask, uint16_t now_ms);
+
+/**
+ * \brief Copies out the oldest completed rep without removing it, so it can stay queued if it can't be sent yet.
+ *
+ * \param dest The summary to fill in.
+ *
+ * \return bool True if there was a rep to copy.
+ */
+bool peek_repetition(rep_summary_t *dest);
+
+/**
+ * \brief Removes the oldest completed rep from the queue.
+ *
+ * \return void
+ */
+void pop_repetition(void);
+
+#endif /* REPETITION_H_ */
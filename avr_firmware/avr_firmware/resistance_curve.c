@@ -0,0 +1,220 @@
+/*
+ * resistance_curve.c
+ *
+ * Created: 2026-10-17
+ */
+
+#include "resistance_curve.h"
+
+#include <stddef.h>
+
+#include "hal.h"
+#include "motor.h"
+#include "current_control.h"
+
+// The steepest slope allowed, CURRENT_SETPOINT_MAX over RES_CURVE_MIN_STEP, still fits in an int16_t with this many fractional bits
+#define SLOPE_FRAC_BITS 11
+
+// Bump this if stored_curve_t or curve_record_t change, so an old record isn't read as a new one
+#define CURVE_VERSION 1
+
+// What gets stored for each motor
+typedef struct
+{
+	uint8_t count;
+	curve_point_t points[RES_CURVE_MAX_POINTS];
+} stored_curve_t;
+
+typedef struct
+{
+	uint8_t version;
+	stored_curve_t curves[MOTOR_COUNT];
+	uint16_t crc;					// CRC-CCITT of everything above
+} curve_record_t;
+
+typedef struct
+{
+	stored_curve_t shape;
+	int16_t slopes[RES_CURVE_MAX_POINTS - 1];	// Current per flexion unit of each segment, with SLOPE_FRAC_BITS fractional bits
+} curve_t;
+
+static curve_record_t EEMEM stored_curves;
+
+static curve_t curves[MOTOR_COUNT];
+
+// Points being uploaded. Only one motor's curve is staged at a time.
+static curve_point_t staged[RES_CURVE_MAX_POINTS];
+static motor staged_motor;
+// Bit n set once staged[n] has been filled in for staged_motor
+static uint8_t staged_mask;
+
+static uint16_t crc_update_block(uint16_t crc, const void *data, size_t len)
+{
+	const uint8_t *bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < len; i++)
+	{
+		crc = _crc_ccitt_update(crc, bytes[i]);
+	}
+	return crc;
+}
+
+// Checks a curve and works out its slopes. Returns 0 if the curve can be used.
+static int build_curve(curve_t *curve)
+{
+	const curve_point_t *points = curve->shape.points;
+	uint8_t count = curve->shape.count;
+	if (count > RES_CURVE_MAX_POINTS)
+	{
+		return 1;
+	}
+
+	for (uint8_t k = 0; k < count; k++)
+	{
+		// Keeping points within one turn also keeps every difference of flexion within an int16_t
+		if (points[k].current > CURRENT_SETPOINT_MAX || points[k].flexion < 0 || points[k].flexion >= KIN_TURN)
+		{
+			return 1;
+		}
+		if (k == 0)
+		{
+			continue;
+		}
+
+		int16_t run = points[k].flexion - points[k - 1].flexion;
+		if (run < RES_CURVE_MIN_STEP)
+		{
+			return 1;
+		}
+		// Rounded towards zero, so interpolating never overshoots the end of the segment
+		int16_t rise = (int16_t)points[k].current - (int16_t)points[k - 1].current;
+		curve->slopes[k - 1] = (int16_t)((int32_t)rise * (1L << SLOPE_FRAC_BITS) / run);
+	}
+	return 0;
+}
+
+static void clear_curves(void)
+{
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		curves[i].shape.count = 0;
+	}
+}
+
+int load_resistance_curves(void)
+{
+	// Read one curve at a time straight into place, rather than the whole record onto the stack
+	uint8_t version = eeprom_read_byte(&stored_curves.version);
+	uint16_t crc = _crc_ccitt_update(0xFFFF, version);
+	bool valid = version == CURVE_VERSION;
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		eeprom_read_block(&curves[i].shape, &stored_curves.curves[i], sizeof(stored_curve_t));
+		crc = crc_update_block(crc, &curves[i].shape, sizeof(stored_curve_t));
+		if (build_curve(&curves[i]) != 0)
+		{
+			valid = false;
+		}
+	}
+	if (!valid || eeprom_read_word(&stored_curves.crc) != crc)
+	{
+		clear_curves();
+		return 1;
+	}
+	return 0;
+}
+
+void save_resistance_curves(void)
+{
+	uint8_t version = CURVE_VERSION;
+	uint16_t crc = _crc_ccitt_update(0xFFFF, version);
+	eeprom_update_byte(&stored_curves.version, version);
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		eeprom_update_block(&curves[i].shape, &stored_curves.curves[i], sizeof(stored_curve_t));
+		crc = crc_update_block(crc, &curves[i].shape, sizeof(stored_curve_t));
+	}
+	eeprom_update_word(&stored_curves.crc, crc);
+}
+
+int stage_curve_point(motor motor_num, uint8_t index, const curve_point_t *point)
+{
+	if (motor_num >= MOTOR_COUNT || index >= RES_CURVE_MAX_POINTS)
+	{
+		return 1;
+	}
+
+	if (motor_num != staged_motor)
+	{
+		staged_motor = motor_num;
+		staged_mask = 0;
+	}
+	staged[index] = *point;
+	staged_mask |= (1<<index);
+	return 0;
+}
+
+int apply_staged_curve(motor motor_num, uint8_t count)
+{
+	if (motor_num >= MOTOR_COUNT || count > RES_CURVE_MAX_POINTS)
+	{
+		return 1;
+	}
+	if (count == 0)
+	{
+		curves[motor_num].shape.count = 0;
+		return 0;
+	}
+
+	uint8_t needed = (uint8_t)((1 << count) - 1);
+	if (motor_num != staged_motor || (staged_mask & needed) != needed)
+	{
+		return 1;
+	}
+
+	curve_t curve;
+	curve.shape.count = count;
+	for (uint8_t k = 0; k < count; k++)
+	{
+		curve.shape.points[k] = staged[k];
+	}
+	if (build_curve(&curve) != 0)
+	{
+		return 1;
+	}
+	curves[motor_num] = curve;
+	return 0;
+}
+
+int evaluate_resistance_curve(motor motor_num, int16_t flexion, uint16_t *current)
+{
+	const curve_t *curve = &curves[motor_num];
+	uint8_t count = curve->shape.count;
+	if (count == 0)
+	{
+		return 1;
+	}
+
+	const curve_point_t *points = curve->shape.points;
+	// Find the first point at or past the finger. Before the first point the curve is flat.
+	uint8_t k = 0;
+	while (k < count && flexion > points[k].flexion)
+	{
+		k++;
+	}
+	if (k == count)
+	{
+		*current = points[count - 1].current;
+	}
+	else if (k == 0 || flexion == points[k].flexion)
+	{
+		*current = points[k].current;
+	}
+	else
+	{
+		const curve_point_t *from = &points[k - 1];
+		// The offset into the segment times the slope is at most the segment's rise, so the result stays between its ends
+		int16_t offset = (int16_t)(((int32_t)(flexion - from->flexion) * curve->slopes[k - 1]) >> SLOPE_FRAC_BITS);
+		*current = (uint16_t)((int16_t)from->current + offset);
+	}
+	return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * resistance_curve.h
+ *
+ * Created: 2026-10-17
+ */
+
+
+#ifndef RESISTANCE_CURVE_H_
+#define RESISTANCE_CURVE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "glove_enums.h"
+#include "kinematics.h"
+
+// Most points in one motor's curve
+#define RES_CURVE_MAX_POINTS 8
+
+// Smallest gap between the flexion of neighbouring points, in KIN_TURN units (about 1.4 degrees).
+// This keeps every segment's slope within 16 bits, so evaluating a curve needs one multiply and no division.
+// Points must also be within one turn, 0 to KIN_TURN - 1.
+#define RES_CURVE_MIN_STEP (KIN_TURN / 256)
+
+// Most cycles evaluating the curves of every motor should take. The benchmark run fails if it's over with full curves.
+#define RES_CURVE_CYCLE_BUDGET 1500
+
+typedef struct
+{
+	int16_t flexion;			// Total flexion of the finger, in KIN_TURN units
+	uint16_t current;			// Motor current setpoint at that flexion, 0 to CURRENT_SETPOINT_MAX
+} curve_point_t;
+
+/**
+ * \brief Loads every motor's curve from EEPROM, replacing the ones in use.
+ *
+ * \return int 0 if the curves were loaded. Nonzero indicates the EEPROM was blank or failed its CRC, and every motor is left without a curve.
+ */
+int load_resistance_curves(void);
+
+/**
+ * \brief Stores every motor's curve in EEPROM with a CRC, so load_resistance_curves() brings them back after a reset.
+ * Blocks while the EEPROM is written, up to 0.6s.
+ *
+ * \return void
+ */
+void save_resistance_curves(void);
+
+/**
+ * \brief Stages one point of a new curve. Nothing changes until apply_staged_curve() is called, so a curve is never used
+ * half uploaded. Staging a point for a different motor than the last one discards the points staged so far.
+ *
+ * \param motor_num The motor the curve is for.
+ * \param index Position of the point in the curve, 0 to RES_CURVE_MAX_POINTS - 1.
+ * \param point The point.
+ *
+ * \return int 0 if the operation was successful. Nonzero indicates an argument out of range.
+ */
+int stage_curve_point(motor motor_num, uint8_t index, const curve_point_t *point);
+
+/**
+ * \brief Replaces a motor's curve with the first count staged points.
+ *
+ * \param motor_num The motor to change.
+ * \param count Number of points, or 0 to remove the motor's curve.
+ *
+ * \return int 0 if the operation was successful. Nonzero indicates the points weren't all staged for this motor, their flexion
+ * doesn't go up by at least RES_CURVE_MIN_STEP from one to the next, or a flexion or current is out of range. The old curve stays in use.
+ */
+int apply_staged_curve(motor motor_num, uint8_t count);
+
+/**
+ * \brief Looks up the motor current for a finger position on a motor's curve, interpolating linearly between points.
+ * The current of the first or last point is held beyond either end. Takes at most RES_CURVE_MAX_POINTS compares and one multiply.
+ *
+ * \param motor_num The motor.
+ * \param flexion Total flexion of the motor's finger, in KIN_TURN units.
+ * \param current The setpoint to fill in.
+ *
+ * \return int 0 if the operation was successful. Nonzero indicates the motor has no curve, and current is left unchanged.
+ */
+int evaluate_resistance_curve(motor motor_num, int16_t flexion, uint16_t *current);
+
+#endif /* RESISTANCE_CURVE_H_ */
@@ -0,0 +1,184 @@
+/*
+ * soft_timer.c
+ *
+ * Created: 2026-10-17
+ */
+
+#include "soft_timer.h"
+
+#include <stddef.h>
+
+#include "hal.h"
+#include "profiler.h"
+
+// Timer 3 counts at F_CPU, so this many counts between ticks
+#define TICK_CYCLES (F_CPU / 1000)
+
+typedef struct
+{
+	uint16_t remaining;				// ms until expiry, 0 if stopped
+	uint16_t period;				// ms between expiries, 0 for a one-shot
+	soft_timer_callback callback;
+	bool expired;
+} soft_timer_t;
+
+static volatile soft_timer_t timers[SOFT_TIMER_COUNT];
+static volatile uint16_t now_ms;
+// Cycle count the latest tick was scheduled for. Its low half is always OCR3A - TICK_CYCLES.
+static volatile uint32_t tick_cycles;
+
+void setup_soft_timers(void)
+{
+	for (uint8_t i = 0; i < SOFT_TIMER_COUNT; i++)
+	{
+		timers[i].remaining = 0;
+		timers[i].period = 0;
+		timers[i].callback = NULL;
+		timers[i].expired = false;
+	}
+
+	// Timer 3 keeps running free for the profiler, so each tick is scheduled relative to the last instead of using CTC mode
+	uint16_t count = TCNT3;
+	tick_cycles = count;
+	OCR3A = count + TICK_CYCLES;
+	TIMSK3 |= (1<<OCIE3A);
+}
+
+void set_timer_callback(soft_timer_id id, soft_timer_callback callback)
+{
+	if (id >= SOFT_TIMER_COUNT)
+	{
+		return;
+	}
+
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		timers[id].callback = callback;
+	}
+}
+
+int start_timer(soft_timer_id id, uint16_t delay_ms, uint16_t period_ms)
+{
+	if (id >= SOFT_TIMER_COUNT || delay_ms == 0)
+	{
+		return 1;
+	}
+
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		timers[id].remaining = delay_ms;
+		timers[id].period = period_ms;
+		timers[id].expired = false;
+	}
+	return 0;
+}
+
+void stop_timer(soft_timer_id id)
+{
+	if (id >= SOFT_TIMER_COUNT)
+	{
+		return;
+	}
+
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		timers[id].remaining = 0;
+	}
+}
+
+bool timer_running(soft_timer_id id)
+{
+	if (id >= SOFT_TIMER_COUNT)
+	{
+		return false;
+	}
+
+	bool running;
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		running = timers[id].remaining != 0;
+	}
+	return running;
+}
+
+uint16_t timer_remaining(soft_timer_id id)
+{
+	if (id >= SOFT_TIMER_COUNT)
+	{
+		return 0;
+	}
+
+	uint16_t remaining;
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		remaining = timers[id].remaining;
+	}
+	return remaining;
+}
+
+uint16_t timer_now(void)
+{
+	uint16_t now;
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		now = now_ms;
+	}
+	return now;
+}
+
+uint32_t timer_cycles(void)
+{
+	uint32_t base;
+	uint16_t count;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		base = tick_cycles;
+		count = TCNT3;
+	}
+	// Cycles since the latest tick. Still right while the next tick is pending with interrupts off, since that's well under a wrap.
+	return base + (uint16_t)(count - (uint16_t)base);
+}
+
+bool timer_expired(soft_timer_id id)
+{
+	if (id >= SOFT_TIMER_COUNT)
+	{
+		return false;
+	}
+
+	bool expired;
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		expired = timers[id].expired;
+		timers[id].expired = false;
+	}
+	return expired;
+}
+
+// Fires every 1ms. This is the only periodic interrupt besides the control tick: the motor ramps, hold timers, timestamps
+// and the profiler's cycle count all run from it, where they used to need the ramp's own compare interrupt and the overflow interrupt.
+ISR(TIMER3_COMPA_vect)
+{
+	uint16_t start = profile_now_irq_off();
+	OCR3A += TICK_CYCLES;
+	tick_cycles += TICK_CYCLES;
+	now_ms++;
+
+	for (uint8_t i = 0; i < SOFT_TIMER_COUNT; i++)
+	{
+		volatile soft_timer_t* timer = &timers[i];
+		if (timer->remaining == 0 || --timer->remaining != 0)
+		{
+			continue;
+		}
+
+		timer->expired = true;
+		timer->remaining = timer->period;
+		if (timer->callback != NULL)
+		{
+			timer->callback();
+		}
+	}
+
+	profile_record_isr(PROFILE_ISR_SOFT_TIMER, start);
+}
@@ -0,0 +1,112 @@
+/*
+ * soft_timer.h
+ *
+ * Created: 2026-10-17
+ */
+
+
+#ifndef SOFT_TIMER_H_
+#define SOFT_TIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "motor.h"
+
+// Every timer in the pool. Each user gets its own entry, so there is nothing to allocate and nothing can run out at runtime.
+typedef enum
+{
+	TIMER_MOTOR_RAMP = 0,
+	// One hold timer per motor, in motor order
+	TIMER_MOTOR_HOLD = 1,
+	TIMER_STARTUP = TIMER_MOTOR_HOLD + MOTOR_COUNT,
+} soft_timer_id;
+
+#define SOFT_TIMER_COUNT (TIMER_STARTUP + 1)
+
+// Called from the 1ms tick interrupt when a timer expires, so it must be short
+typedef void (*soft_timer_callback)(void);
+
+/**
+ * \brief Starts the 1ms tick on timer 3 compare A. Timer 3 must already be running free at clk/1. All timers start stopped.
+ * The tick is the only timer 3 interrupt: it also extends the cycle count for timer_cycles().
+ *
+ * \return void
+ */
+void setup_soft_timers(void);
+
+/**
+ * \brief Sets the function called every time a timer expires. Set it before starting the timer.
+ *
+ * \param id The timer.
+ * \param callback Function to call from the tick interrupt, or NULL to only set the expired flag.
+ *
+ * \return void
+ */
+void set_timer_callback(soft_timer_id id, soft_timer_callback callback);
+
+/**
+ * \brief Starts or restarts a timer and clears its expired flag.
+ *
+ * \param id The timer.
+ * \param delay_ms Time until it first expires, 1 to 65535ms.
+ * \param period_ms Time between later expiries for a periodic timer, or 0 for a one-shot.
+ *
+ * \return int 0 if the operation was successful. Nonzero indicates an argument out of range.
+ */
+int start_timer(soft_timer_id id, uint16_t delay_ms, uint16_t period_ms);
+
+/**
+ * \brief Stops a timer without expiring it.
+ *
+ * \param id The timer.
+ *
+ * \return void
+ */
+void stop_timer(soft_timer_id id);
+
+/**
+ * \brief Checks if a timer is still counting down. A periodic timer keeps running until it is stopped.
+ *
+ * \param id The timer.
+ *
+ * \return bool True if the timer has been started and hasn't expired or been stopped yet.
+ */
+bool timer_running(soft_timer_id id);
+
+/**
+ * \brief Returns how long a timer has left to run, for measuring how much of a timeout has been used.
+ *
+ * \param id The timer.
+ *
+ * \return uint16_t Time until the timer next expires in ms, or 0 if it isn't running.
+ */
+uint16_t timer_remaining(soft_timer_id id);
+
+/**
+ * \brief Returns a millisecond count that goes up with every tick, for timestamping events without using up a timer.
+ * Differences between two timestamps are correct as long as less than 65536ms pass between them.
+ *
+ * \return uint16_t The current timestamp in ms.
+ */
+uint16_t timer_now(void);
+
+/**
+ * \brief Returns a free running count of CPU cycles: the timer 3 count, extended to 32 bits by counting the 1ms ticks.
+ * This needs no overflow interrupt, as long as interrupts are never held off for longer than timer 3 takes to wrap (8.2ms).
+ * Differences between two counts are correct for about 9 minutes.
+ *
+ * \return uint32_t The current count in cycles.
+ */
+uint32_t timer_cycles(void);
+
+/**
+ * \brief Checks and clears a timer's expired flag, for polling a timer from the main loop instead of using a callback.
+ *
+ * \param id The timer.
+ *
+ * \return bool True if the timer has expired at least once since it was started or last checked.
+ */
+bool timer_expired(soft_timer_id id);
+
+#endif /* SOFT_TIMER_H_ */
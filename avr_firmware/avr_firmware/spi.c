@@ -8,124 +8,481 @@
 #include "spi.h"
 #include <stdlib.h>
 
-#define F_CPU 8000000UL
 #include "uart.h"
+#include "motor.h"
+#include "profiler.h"
+#include "filter.h"
 #include <stdio.h>
-#include <util/delay.h>
+
+// Number of channels converted in each scan: every pot followed by every motor current.
+#define SCAN_CHANNEL_COUNT (POT_COUNT + MOTOR_COUNT)
+
+// Second byte of an MCP3008 transaction: single ended conversion of the channel in bits 6-4
+#define MCP3008_SINGLE(ch) (0b10000000 | ((ch) << 4))
+// Layout of a raw transaction result. The ADC drives a 0 null bit just ahead of the 10 bit value.
+#define MCP3008_VALUE_MASK 0x03FF
+#define MCP3008_NULL_BIT 0x0400
+
+// Number of paired reads of every channel used to check each SPI clock rate during calibration
+#define SPI_CALIBRATION_PASSES 4
+// Largest difference between a pair of reads, in ADC counts, still accepted as the same value during calibration
+#define SPI_CALIBRATION_TOLERANCE 8
+
+typedef struct
+{
+	uint8_t spcr;					// Clock rate bits of SPCR1
+	uint8_t spsr;					// Clock rate bits of SPSR1
+	uint8_t divider;				// F_CPU / SPI clock
+} spi_rate_t;
+
+// SPI1 clock rates, fastest first. The last one is the known good rate that the others are checked against.
+// F_CPU/2 is left out since 4MHz is past the MCP3008's limit at any supply voltage.
+static const spi_rate_t spi_rates[] =
+{
+	{ 0, 0, 4 },
+	{ 1<<SPR10, 1<<SPI2X1, 8 },
+	{ 1<<SPR10, 0, 16 },
+	{ 1<<SPR11, 1<<SPI2X1, 32 },
+	{ 1<<SPR11, 0, 64 },
+};
+
+#define SPI_RATE_COUNT (sizeof(spi_rates) / sizeof(spi_rates[0]))
+#define SPI_SAFE_RATE (SPI_RATE_COUNT - 1)
+
+static uint8_t spi_divider;
+
+typedef struct
+{
+	volatile uint8_t* cs_port;		// Port holding the ADC's chip select
+	uint8_t cs_mask;				// Chip select pin on that port
+	uint8_t command;				// MCP3008 command byte for the channel
+} adc_channel_t;
+
+// Pots use 7 channels on each of ADCs 0 and 1, motors use channels 0-4 on ADC 2
+#define ADC0_CHANNEL(ch) { &PORTE, 1<<PORTE2, MCP3008_SINGLE(ch) }
+#define ADC1_CHANNEL(ch) { &PORTC, 1<<PORTC2, MCP3008_SINGLE(ch) }
+#define ADC2_CHANNEL(ch) { &PORTC, 1<<PORTC3, MCP3008_SINGLE(ch) }
+
+// Where each logical channel is wired, in scan order: indexed by potentiometer, then POT_COUNT + motor.
+static const adc_channel_t adc_channels[SCAN_CHANNEL_COUNT] =
+{
+	ADC0_CHANNEL(0), ADC0_CHANNEL(1), ADC0_CHANNEL(2), ADC0_CHANNEL(3), ADC0_CHANNEL(4), ADC0_CHANNEL(5), ADC0_CHANNEL(6),
+	ADC1_CHANNEL(0), ADC1_CHANNEL(1), ADC1_CHANNEL(2), ADC1_CHANNEL(3), ADC1_CHANNEL(4), ADC1_CHANNEL(5), ADC1_CHANNEL(6),
+	ADC2_CHANNEL(0), ADC2_CHANNEL(1), ADC2_CHANNEL(2), ADC2_CHANNEL(3), ADC2_CHANNEL(4)
+};
+
+// Double buffer for the background scan.
+// The ISR fills scan_buffers[scan_front ^ 1], then flips scan_front once every channel has been converted.
+// The main loop only ever reads the front buffer.
+static volatile adc_readings_t scan_buffers[2];
+static volatile uint8_t scan_front;
+static volatile uint8_t scan_count;
+
+// Scan state machine. Only touched by the ISR while scan_running is set.
+static volatile bool scan_running;
+static volatile bool scan_continuous;
+static uint8_t scan_channel;	// Logical channel, 0-13 are pots and 14-18 are motors
+static uint8_t scan_byte;		// Index of the byte currently being transferred, 0-2
+static uint16_t scan_result;
+static uint8_t scan_sample;		// Conversions of scan_channel done so far
+static uint16_t scan_sum;		// Sum of those conversions
+
+// Filter state for every channel, in scan order. Used by the scan ISR, or by read_pot()/read_motor() while no scan is running.
+static filter_channel_t filters[SCAN_CHANNEL_COUNT];
+// Filter settings for the scan in progress, so a change from the main loop can't land halfway through an oversampled channel
+static filter_config_t scan_configs[FILTER_GROUP_COUNT];
+
+static void scan_begin_channel(void);
+
+// The chip selects share ports with pins written from ISRs, so these must run with interrupts off
+static inline void adc_select(const adc_channel_t *channel)
+{
+	*channel->cs_port &= ~channel->cs_mask;
+}
+
+static inline void adc_deselect(const adc_channel_t *channel)
+{
+	*channel->cs_port |= channel->cs_mask;
+}
+
+// Waits for a polled SPI1 transfer to complete and returns the byte received
+static inline uint8_t spi_exchange(uint8_t data)
+{
+	hal_spi1_write(data);
+	while (!(SPSR1 & (1<<SPIF1)));
+	return hal_spi1_read();
+}
+
+// One polled 3-byte MCP3008 transaction on a channel, with its chip select driven low for the duration.
+// Returns the 10 bit value with the null bit above it.
+static uint16_t convert_raw(const adc_channel_t *channel)
+{
+	uint16_t result;
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		adc_select(channel);
+	}
+	
+	// 1. Send 0b00000001. The final bit acts as the start bit to the ADC.
+	spi_exchange(0x01);
+	// 2. Send 0b1XXX0000, where XXX is the 3-bit channel number.
+	// The MSB is 1 to indicate single ended conversion as opposed to differential pair.
+	// The ADC will respond with the most significant 2 bits of the converted value.
+	result = (spi_exchange(channel->command) & 0b00000111) << 8;
+	// 3. Send a don't-care byte to keep the clock going while the ADC sends the remaining 8 bits.
+	result |= spi_exchange(0);
+	
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		adc_deselect(channel);
+	}
+	return result;
+}
+
+static inline uint16_t convert(const adc_channel_t *channel)
+{
+	return convert_raw(channel) & MCP3008_VALUE_MASK;
+}
+
+static void set_spi_rate(const spi_rate_t *rate)
+{
+	SPCR1 = (SPCR1 & ~((1<<SPR11) | (1<<SPR10))) | rate->spcr;
+	SPSR1 = rate->spsr;
+	spi_divider = rate->divider;
+}
+
+// Reads every channel at a rate, each read right after a read at the safe rate, and checks that both transfers are clean and agree.
+// Pairing the reads keeps a finger moving during calibration from looking like a bad transfer.
+static bool spi_rate_reliable(const spi_rate_t *rate)
+{
+	for (uint8_t pass = 0; pass < SPI_CALIBRATION_PASSES; pass++)
+	{
+		for (uint8_t i = 0; i < SCAN_CHANNEL_COUNT; i++)
+		{
+			set_spi_rate(&spi_rates[SPI_SAFE_RATE]);
+			uint16_t reference = convert_raw(&adc_channels[i]);
+			set_spi_rate(rate);
+			uint16_t raw = convert_raw(&adc_channels[i]);
+			if ((reference | raw) & MCP3008_NULL_BIT)
+			{
+				return false;
+			}
+			
+			int16_t diff = (int16_t)raw - (int16_t)reference;
+			if (diff > SPI_CALIBRATION_TOLERANCE || diff < -SPI_CALIBRATION_TOLERANCE)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static inline filter_group channel_group(uint8_t channel)
+{
+	return channel < POT_COUNT ? FILTER_GROUP_POTS : FILTER_GROUP_MOTORS;
+}
+
+// Filter outputs carry more fractional bits than the published readings
+static inline int16_t to_reading(int16_t state)
+{
+	return state >> (FILTER_STATE_FRAC_BITS - POT_FILTER_SHIFT);
+}
+
+static inline void store_reading(volatile adc_readings_t *dest, uint8_t channel, int16_t value)
+{
+	if (channel < POT_COUNT)
+	{
+		dest->potentiometers[channel] = value;
+	}
+	else
+	{
+		dest->motors[channel - POT_COUNT] = value;
+	}
+}
+
+static void scan_load_configs(void)
+{
+	for (uint8_t group = 0; group < FILTER_GROUP_COUNT; group++)
+	{
+		get_filter_config(group, &scan_configs[group]);
+	}
+}
 
 void setup_spi(void)
 {
 	// Set MOSI1 and SCK1 output
 	DDRC |= (1<<DDC1);
 	DDRE |= (1<<DDE3);
-	// Enable SPI1 in master mode, MSB first, CPOL = 0, CPHA = 0, clock division factor = 16
-	// N.B. I put /16 here as a default, we can try ramping up the speed later if everything is stable
-	SPCR1 = (1<<SPE1) | (1<<MSTR1) | (1<<SPR1);
+	// Enable SPI1 in master mode, MSB first, CPOL = 0, CPHA = 0
+	SPCR1 = (1<<SPE1) | (1<<MSTR1);
+	// Start at the slowest rate, clock division factor = 64, until calibrate_spi_clock() finds a faster one
+	set_spi_rate(&spi_rates[SPI_SAFE_RATE]);
 }
 
-int read_pot(potentiometer pot_index, adc_readings_t *dest)
+uint8_t calibrate_spi_clock(void)
 {
-	if (pot_index > POT_PINKY_3 || dest == NULL)
+	if (scan_running)
 	{
-		return 1;
+		return spi_divider;
 	}
 	
-	// 7 channels used per ADC
-	uint8_t adc_num = pot_index / 7;
-	uint8_t adc_ch = pot_index % 7;
-	
-	if (toggle_adc_ss(adc_num)) return 1;
-	
-	uint16_t result;
-	if (read(adc_ch, &result)) return 1;
-	if (toggle_adc_ss(adc_num)) return 1;
+	for (uint8_t rate = 0; rate < SPI_SAFE_RATE; rate++)
+	{
+		if (spi_rate_reliable(&spi_rates[rate]))
+		{
+			set_spi_rate(&spi_rates[rate]);
+			return spi_divider;
+		}
+	}
 	
-	// Convert the reading to fixed point
-	int16_t r2 = (int16_t)result << POT_FILTER_SHIFT;
+	// Every faster rate failed, or not even the safe rate reads back cleanly
+	set_spi_rate(&spi_rates[SPI_SAFE_RATE]);
+	return spi_divider;
+}
 
-	// Save the previous reading from dest
-	int16_t prev_out = dest->potentiometers[pot_index];
-	
-	// Perform the filtering operation and store the new filter output
-	dest->potentiometers[pot_index] = prev_out + ((r2 - prev_out) >> POT_FILTER_SHIFT);
-	
-	return 0;
+uint8_t get_spi_clock_divider(void)
+{
+	return spi_divider;
 }
 
-int read_motor(motor motor_index, adc_readings_t *dest)
+int start_adc_scan(bool continuous)
 {
-	if (motor_index > MOTOR_THUMB || dest == NULL)
+	if (scan_running)
 	{
 		return 1;
 	}
 	
-	if (toggle_adc_ss(2)) return 1;
-	
-	uint16_t result;
-	if (read(motor_index, &result)) return 1;
-	if (toggle_adc_ss(2)) return 1;
-	
-	// Convert the reading to fixed point
-	int16_t r2 = (int16_t)result << POT_FILTER_SHIFT;
-
-	// Save the previous reading from dest
-	int16_t prev_out = dest->motors[motor_index];
+	scan_continuous = continuous;
+	scan_running = true;
+	scan_channel = 0;
+	scan_sample = 0;
+	scan_sum = 0;
+	scan_load_configs();
 	
-	// Perform the filtering operation and store the new filter output
-	dest->motors[motor_index] = prev_out + ((r2 - prev_out) >> POT_FILTER_SHIFT);
+	// Let the SPI1 transfer complete interrupt drive the rest of the scan
+	SPCR1 |= (1<<SPIE1);
+	// Called from the main loop, so keep the ISRs off the chip select ports while selecting the first channel
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		scan_begin_channel();
+	}
 	return 0;
 }
 
-int toggle_adc_ss(uint8_t adc_num)
-{	
-	switch (adc_num)
+void stop_adc_scan(void)
+{
+	scan_continuous = false;
+}
+
+bool adc_scan_busy(void)
+{
+	return scan_running;
+}
+
+uint8_t get_latest_readings(adc_readings_t *dest)
+{
+	uint8_t count;
+	// If the ISR publishes a new scan while we're copying, the buffer we were reading from may start being overwritten
+	// by the scan after that one, so start over. A scan takes much longer than the copy so this almost never repeats.
+	do
+	{
+		count = scan_count;
+		volatile adc_readings_t *src = &scan_buffers[scan_front];
+		for (uint8_t i = 0; i < POT_COUNT; i++)
+		{
+			dest->potentiometers[i] = src->potentiometers[i];
+		}
+		for (uint8_t i = 0; i < MOTOR_COUNT; i++)
+		{
+			dest->motors[i] = src->motors[i];
+		}
+	} while (count != scan_count);
+	return count;
+}
+
+// Selects the ADC for the current scan channel and sends the start bit. The rest of the transfer happens in the ISR.
+// Must run with interrupts off, like adc_select().
+static void scan_begin_channel(void)
+{
+	scan_byte = 0;
+	adc_select(&adc_channels[scan_channel]);
+	hal_spi1_write(0x01);
+}
+
+// Runs the background scan forward by one byte. Implements the same 3-byte MCP3008 transaction as convert().
+static inline void scan_next(void)
+{
+	switch (scan_byte)
 	{
 	case 0:
-		PORTE ^= (1<<PORTE2);
-		break;
+		// Start bit sent, request a single ended conversion on the channel
+		scan_byte = 1;
+		hal_spi1_write(adc_channels[scan_channel].command);
+		return;
 	case 1:
-		PORTC ^= (1<<PORTC2);
-		break;
-	case 2:
-		PORTC ^= (1<<PORTC3);
-		break;
+		// ADC responded with the top 2 bits, clock out the remaining 8
+		scan_result = (hal_spi1_read() & 0b00000011) << 8;
+		scan_byte = 2;
+		hal_spi1_write(0);
+		return;
 	default:
-		// ADC number out of range
+		break;
+	}
+	
+	// Transaction complete, release the chip select
+	scan_result |= hal_spi1_read();
+	adc_deselect(&adc_channels[scan_channel]);
+	
+	// Convert the same channel again until it has been oversampled enough
+	const filter_config_t *config = &scan_configs[channel_group(scan_channel)];
+	scan_sum += scan_result;
+	scan_sample++;
+	if (scan_sample < (1 << config->oversample_shift))
+	{
+		scan_begin_channel();
+		return;
+	}
+	
+	// Filter and store into the back buffer
+	uint8_t front = scan_front;
+	store_reading(&scan_buffers[front ^ 1], scan_channel, to_reading(run_filter(&filters[scan_channel], config, scan_sum)));
+	scan_sample = 0;
+	scan_sum = 0;
+	
+	scan_channel++;
+	if (scan_channel < SCAN_CHANNEL_COUNT)
+	{
+		scan_begin_channel();
+		return;
+	}
+	
+	// Every channel has been converted, publish the back buffer
+	scan_front = front ^ 1;
+	scan_count++;
+	
+	if (scan_continuous)
+	{
+		scan_channel = 0;
+		scan_load_configs();
+		scan_begin_channel();
+	}
+	else
+	{
+		SPCR1 &= ~(1<<SPIE1);
+		scan_running = false;
+	}
+}
+
+// Fires when a byte has finished shifting out on SPI1
+ISR(SPI1_STC_vect)
+{
+	uint16_t start = profile_now_irq_off();
+	scan_next();
+	profile_record_isr(PROFILE_ISR_SPI1, start);
+}
+
+// Blocking version of one scan channel: oversample, then filter with the channel's scan state
+static int16_t convert_filtered(uint8_t channel, const filter_config_t *config)
+{
+	const adc_channel_t *entry = &adc_channels[channel];
+	uint16_t sum = 0;
+	for (uint8_t i = 0; i < (1 << config->oversample_shift); i++)
+	{
+		sum += convert(entry);
+	}
+	return to_reading(run_filter(&filters[channel], config, sum));
+}
+
+int scan_all(adc_readings_t *dest)
+{
+	if (dest == NULL || scan_running)
+	{
 		return 1;
 	}
+	
+	filter_config_t configs[FILTER_GROUP_COUNT];
+	for (uint8_t group = 0; group < FILTER_GROUP_COUNT; group++)
+	{
+		get_filter_config(group, &configs[group]);
+	}
+	
+	for (uint8_t i = 0; i < POT_COUNT; i++)
+	{
+		dest->potentiometers[i] = convert_filtered(i, &configs[FILTER_GROUP_POTS]);
+	}
+	for (uint8_t i = 0; i < MOTOR_COUNT; i++)
+	{
+		dest->motors[i] = convert_filtered(POT_COUNT + i, &configs[FILTER_GROUP_MOTORS]);
+	}
 	return 0;
 }
 
-int read(uint8_t channel_num, uint16_t *dest)
+int warm_start_filters(uint16_t *max_variance)
 {
-	if (channel_num > 7)
+	if (max_variance == NULL || scan_running)
 	{
 		return 1;
 	}
 	
-	uint16_t result;
-	
-	// 1. Send 0b00000001. The final bit acts as the start bit to the ADC.
-	SPDR1 = 0x01;
-	while (!(SPSR1 & (1<<SPIF1)));
+	uint16_t worst = 0;
+	volatile adc_readings_t *next = &scan_buffers[scan_front ^ 1];
+	for (uint8_t i = 0; i < SCAN_CHANNEL_COUNT; i++)
+	{
+		// Back to back conversions, so only noise shows up in the variance and not the finger moving
+		const adc_channel_t *entry = &adc_channels[i];
+		uint16_t sum = 0;
+		uint32_t sum_sq = 0;
+		for (uint8_t n = 0; n < (1 << WARM_START_SHIFT); n++)
+		{
+			uint16_t x = convert(entry);
+			sum += x;
+			sum_sq += (uint32_t)x * x;
+		}
+		
+		// Population variance, E[x^2] - E[x]^2
+		uint32_t variance = (sum_sq - (((uint32_t)sum * sum) >> WARM_START_SHIFT)) >> WARM_START_SHIFT;
+		if (variance > worst)
+		{
+			worst = variance > UINT16_MAX ? UINT16_MAX : (uint16_t)variance;
+		}
+		
+		// The mean of 2^WARM_START_SHIFT samples has that many fractional bits
+		int16_t seed = (int16_t)(sum << (FILTER_STATE_FRAC_BITS - WARM_START_SHIFT));
+		seed_filter_channel(&filters[i], seed);
+		store_reading(next, i, to_reading(seed));
+	}
 	
-	// 2. Send 0b1XXX0000, where XXX is the 3-bit channel number.
-	// The MSB is 1 to indicate single ended conversion as opposed to differential pair.
-	// The remaining bits are don't-care bits that are left as 0 for simplicity.
-	// The ADC will respond with the most significant 2 bits of the converted value.
-	uint8_t byte2 = 0b10000000;
-	byte2 |= (channel_num << 4) & 0b01110000;
-	SPDR1 = byte2;
+	// Publish the seeded values like a completed scan
+	scan_front ^= 1;
+	scan_count++;
 	
-	while (!(SPSR1 & (1<<SPIF1)));
-	result = (SPDR1 & 0b00000011) << 8;
+	*max_variance = worst;
+	return 0;
+}
+
+int read_pot(potentiometer pot_index, adc_readings_t *dest)
+{
+	if (pot_index > POT_PINKY_3 || dest == NULL || scan_running)
+	{
+		return 1;
+	}
 	
-	// 3. Send 0b00000000. This entire byte is a don't-care byte, but we need to send something to keep the clock going while we read the response.
-	// The ADC will respond with the remaining 8 bits.
-	SPDR1 = 0;
-	while (!(SPSR1 & (1<<SPIF1)));
-	result |= SPDR1;
+	filter_config_t config;
+	get_filter_config(FILTER_GROUP_POTS, &config);
+	dest->potentiometers[pot_index] = convert_filtered(pot_index, &config);
+	return 0;
+}
+
+int read_motor(motor motor_index, adc_readings_t *dest)
+{
+	if (motor_index > MOTOR_THUMB || dest == NULL || scan_running)
+	{
+		return 1;
+	}
 	
-	*dest = result;
+	filter_config_t config;
+	get_filter_config(FILTER_GROUP_MOTORS, &config);
+	dest->motors[motor_index] = convert_filtered(POT_COUNT + motor_index, &config);
 	return 0;
 }
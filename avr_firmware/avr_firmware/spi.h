@@ -9,19 +9,27 @@
 #ifndef SPI_H_
 #define SPI_H_
 
-// Determines the scaling factor used for the noise filtering on the potentiometer readings.
-// The scaling factor is 1/2^N where N is the value defined here.
-// The division is implemented by a right shift.
+// Number of fractional bits in the filtered readings. Shift a reading right by this much to get ADC counts.
+// The filtering itself is set per channel group at runtime, see filter.h.
 #define POT_FILTER_SHIFT 3
 
-#include <avr/io.h>
 #include <stdint.h>
+#include <stdbool.h>
 
+#include "hal.h"
 #include "glove_enums.h"
 
+// The warm start averages 2^N back to back samples of each channel. N can't be more than FILTER_STATE_FRAC_BITS.
+#define WARM_START_SHIFT 3
+// Readings count as settled once no channel's warm start burst has a variance above this, in ADC counts squared
+#define WARM_START_MAX_VARIANCE 9
+
+// Number of potentiometer channels, spread over the first two ADCs (7 channels each).
+#define POT_COUNT 14
+
 typedef struct adc_readings 
 {
-	int16_t potentiometers[14];
+	int16_t potentiometers[POT_COUNT];
 	int16_t motors[5];
 } adc_readings_t;
 
@@ -35,42 +43,94 @@ typedef struct adc_readings
 void setup_spi(void);
 
 /**
- * \brief Reads the potentiometer with the specified index and stores the result in an adc_readings_t struct.
+ * \brief Finds the fastest SPI1 clock the ADCs still read back reliably at, and switches to it. Each faster rate is tried from the
+ * fastest down, reading every channel several times, each read paired with one at the slowest rate. A rate is accepted once every
+ * pair has a clean MCP3008 null bit and agrees within a few counts. Boards that fail every faster rate keep the slowest.
+ * Call after setup_gpio() and setup_spi(), before any scan is started. Blocks for 15ms to 60ms.
  * 
- * \param pot_index The potentiometer index to read, 0-13.
- * \param dest The destination structure to store the result in.
+ * \return uint8_t The chosen clock divider, F_CPU / SPI clock.
+ */
+uint8_t calibrate_spi_clock(void);
+
+/**
+ * \brief Returns the SPI1 clock divider in use.
  * 
- * \return int 0 if the operation was successful. Nonzero indicates an argument out of range.
+ * \return uint8_t F_CPU / SPI clock, 4 to 64.
  */
-int read_pot(potentiometer pot_index, adc_readings_t *dest);
+uint8_t get_spi_clock_divider(void);
 
 /**
- * \brief Reads the motor current with the specified index and stores the result in an adc_readings_t struct.
+ * \brief Starts a background scan of every potentiometer and motor channel. The scan is driven by the SPI1 serial transfer complete interrupt, so this returns immediately.
+ * The filtered results are published once the whole scan has completed and can be fetched with get_latest_readings().
  * 
- * \param pot_index The motor index to read, 0-4.
- * \param dest The destination structure to store the result in.
+ * \param continuous If true, a new scan is started as soon as the previous one completes until stop_adc_scan() is called. If false, a single scan is performed.
  * 
- * \return int 0 if the operation was successful. Nonzero indicates an argument out of range.
+ * \return int 0 if the scan was started. Nonzero indicates a scan is already in progress.
  */
-int read_motor(motor motor_index, adc_readings_t *dest);
+int start_adc_scan(bool continuous);
 
 /**
- * \brief Toggles the slave select/chip select (SS/CS) pin of a particular ADC. SS pins are active low and idle high. Only one SS pin should be low at a time.
+ * \brief Stops a continuous background scan. The scan currently in progress (if any) is allowed to complete and is still published.
  * 
- * \param adc_num The ADC to set (0-2).
+ * \return void
+ */
+void stop_adc_scan(void);
+
+/**
+ * \brief Checks whether a background scan is currently running.
+ * 
+ * \return bool True if the SPI bus is in use by the background scan.
+ */
+bool adc_scan_busy(void);
+
+/**
+ * \brief Copies the most recently completed scan into dest. Safe to call from the main loop while a scan is running; no interrupts are disabled.
  * 
- * \return int 0 if the operation was successful. Nonzero indicates an argument out of range.
+ * \param dest The destination structure to store the filtered readings in.
+ * 
+ * \return uint8_t The number of scans completed so far (wraps around). Compare against a previous value to check whether new data is available.
  */
-int toggle_adc_ss(uint8_t adc_num);
+uint8_t get_latest_readings(adc_readings_t *dest);
 
 /**
- * \brief Issues commands to read a particular channel, and then stores the returned data at a destination address. The corresponding SS pin must already be low.
+ * \brief Converts every potentiometer and motor channel in one blocking pass, filtering each like the background scan would.
+ * Channels are looked up in a table of chip selects and MCP3008 command bytes in spi.c, so remapping a channel is a table edit.
  * 
- * \param channel_num The channel to read (0-7).
- * \param dest A memory address to store the returned value in.
+ * \param dest The destination structure to store the filtered readings in.
  * 
- * \return int 0 if the operation was successful. Nonzero indicates an argument out of range.
+ * \return int 0 if the operation was successful. Nonzero indicates a NULL destination or a background scan in progress.
  */
-int read(uint8_t channel_num, uint16_t *dest);
+int scan_all(adc_readings_t *dest);
+
+/**
+ * \brief Seeds every channel's filter with the mean of a burst of raw samples, so readings are valid straight away instead of
+ * rising from 0 through the IIR. The seeded values are published like a completed scan. Repeat until the returned variance shows
+ * the readings have settled.
+ * 
+ * \param max_variance Set to the largest variance of any channel's burst, in ADC counts squared.
+ * 
+ * \return int 0 if the operation was successful. Nonzero indicates a NULL argument or a background scan in progress.
+ */
+int warm_start_filters(uint16_t *max_variance);
+
+/**
+ * \brief Reads the potentiometer with the specified index, filters it like the background scan would and stores the result in an adc_readings_t struct.
+ * 
+ * \param pot_index The potentiometer index to read, 0-13.
+ * \param dest The destination structure to store the result in.
+ * 
+ * \return int 0 if the operation was successful. Nonzero indicates an argument out of range or a background scan in progress.
+ */
+int read_pot(potentiometer pot_index, adc_readings_t *dest);
+
+/**
+ * \brief Reads the motor current with the specified index, filters it like the background scan would and stores the result in an adc_readings_t struct.
+ * 
+ * \param pot_index The motor index to read, 0-4.
+ * \param dest The destination structure to store the result in.
+ * 
+ * \return int 0 if the operation was successful. Nonzero indicates an argument out of range or a background scan in progress.
+ */
+int read_motor(motor motor_index, adc_readings_t *dest);
 
 #endif /* SPI_H_ */
\ No newline at end of file
@@ -7,39 +7,114 @@
 
 #include "uart.h"
 
-#include <util/atomic.h>
-#include <avr/interrupt.h>
-#include <avr/io.h>
-
+#include <string.h>
+#include <stdbool.h>
+#include "hal.h"
 #include "circular_buffer.h"
+#include "motor.h"
+#include "control_tick.h"
+#include "profiler.h"
 
 // The clock rate of the system is 8 MHz.
 // When not running the UART at double speed, UBRR = f_osc / (16*Baud) - 1
+// At double speed (U2X), UBRR = f_osc / (8*Baud) - 1
 // The below value is for 9600 baud.
 #define DEBUG_UBRR 51
 
-// Circular buffers for debug/Bluetooth send and receive.
+typedef struct baud_setting
+{
+	uint32_t baud;
+	uint16_t ubrr;
+	bool u2x;
+} baud_setting_t;
+
+// Supported rates, indexed by the baud code used in the negotiation commands.
+// All are within about 2% of the nominal rate at 8 MHz except 115200, which is -3.5% and may not work with every host.
+static const baud_setting_t baud_table[UART_BAUD_COUNT] =
+{
+	{ 9600, DEBUG_UBRR, false },
+	{ 19200, 25, false },
+	{ 38400, 25, true },
+	{ 57600, 16, true },
+	{ 76800, 12, true },
+	{ 115200, 8, true },
+	{ 250000, 3, true },
+	{ 500000, 1, true },
+};
+
+// Baud rate change state for each link.
+// A change goes IDLE -> DRAINING (ack queued at the old rate) -> HOLDOFF (waiting for the last bytes to shift out) -> CONFIRMING (switched, waiting for the host).
+typedef enum
+{
+	BAUD_IDLE,
+	BAUD_DRAINING,
+	BAUD_HOLDOFF,
+	BAUD_CONFIRMING
+} baud_state;
+
+static uint8_t baud_codes[UART_LINK_COUNT];
+static uint8_t previous_baud_codes[UART_LINK_COUNT];
+static baud_state baud_states[UART_LINK_COUNT];
+static uint16_t baud_ticks[UART_LINK_COUNT];
+
+// Throughput test. While test_link is set, the UDRE ISR of that link sends an incrementing byte pattern instead of the send buffer.
+#define TEST_LINK_NONE 0xFF
+static volatile uint8_t test_link = TEST_LINK_NONE;
+static volatile uint32_t test_bytes;
+static volatile uint8_t test_pattern;
+static uint8_t test_pending_link = TEST_LINK_NONE;
+static uint16_t test_ticks_left;
+static uint16_t test_ticks_total;
+// Control tick rate the test was timed with
+static uint16_t test_tick_rate;
+
+// Framing, overrun and parity errors seen by each receiver
+static volatile uint16_t rx_errors[UART_LINK_COUNT];
+
+// Circular buffers for Bluetooth/debug send and receive, indexed by uart_link.
 // When the main loop sends data, it's copied into the buffer.
 // Data is asynchronously transmitted out of the buffer in the background using interrupts.
-static volatile circular_buffer_t debug_send_buf;
-static volatile circular_buffer_t debug_recv_buf;
-//static volatile circular_buffer_t bt_send_buf;
-//static volatile circular_buffer_t bt_recv_buf;
+static volatile circular_buffer_t send_bufs[UART_LINK_COUNT];
+static volatile circular_buffer_t recv_bufs[UART_LINK_COUNT];
+
+// Which link each stream is currently sent on, indexed by uart_stream
+static uart_link stream_links[UART_STREAM_COUNT] = { UART_LINK_BT, UART_LINK_DEBUG };
+
+// Number of frames refused because the send buffer didn't have room for the whole frame.
+// Only modified from the main loop.
+static uint16_t frames_dropped;
+
+// Sequence number of the next snapshot or delta frame. Only incremented when a frame is actually queued,
+// so a gap seen by the app always means data was lost on the link.
+static uint8_t snapshot_seq;
+
+// Channel values as of the last snapshot or delta frame that was queued. Delta frames are encoded against these.
+static uint16_t delta_ref[POT_COUNT + MOTOR_COUNT];
+static bool compressed_telemetry;
+// Frames sent since the last keyframe. 0 forces the next frame to be a keyframe.
+static uint8_t frames_since_keyframe;
+
+static int send_frame(uart_stream stream, char* msg, size_t len);
+static int send_link_frame(uart_link link, char* msg, size_t len);
 
 void setup_uart(void)
 {
-	// Initialize circular buffers for debug
-	circ_buf_init(&debug_send_buf);
-	circ_buf_init(&debug_recv_buf);
-	//circ_buf_init(&bt_send_buf);
-	//circ_buf_init(&bt_recv_buf);
+	// Initialize circular buffers for both links
+	for (uint8_t i = 0; i < UART_LINK_COUNT; i++)
+	{
+		circ_buf_init(&send_bufs[i]);
+		circ_buf_init(&recv_bufs[i]);
+	}
 	
 	/* USART0 (Bluetooth) initialization */
-	// Disabled for demo because UART0 not working properly
-	//UCSR0B = (1<<RXCIE0) | (1<<UDRIE0) | (1<<RXEN0) | (1<<TXEN0);
-	//UCSR0C = (1<UCSZ01) | (1<<UCSZ00);
-	//UBRR0H = (unsigned char)(DEBUG_UBRR >> 8);
-	//UBRR0L = (unsigned char)DEBUG_UBRR;
+	// Enable RX complete, TX data register empty interrupts. Enable receiver and transmitter.
+	UCSR0B = (1<<RXCIE0) | (1<<UDRIE0) | (1<<RXEN0) | (1<<TXEN0);
+	// Set asynchronous, no parity, 1 stop bit, 8 data bits.
+	// N.B. This used to say (1<UCSZ01), which set UCPOL0 instead of UCSZ01 and left the port in 6 bit mode. That's why USART0 didn't work for the demo.
+	UCSR0C = (1<<UCSZ01) | (1<<UCSZ00);
+	// Set baud rate.
+	UBRR0H = (unsigned char)(DEBUG_UBRR >> 8);
+	UBRR0L = (unsigned char)DEBUG_UBRR;
 	
 	/* USART1 (Debug serial) initialization */
 	// Enable RX complete, TX data register empty interrupts. Enable receiver and transmitter.
@@ -51,117 +126,640 @@ void setup_uart(void)
 	UBRR1L = (unsigned char)DEBUG_UBRR;
 }
 
-void debug_send(char* msg)
+// N.B. The send buffers are only ever written from the main loop and read from the UDRE ISR, and the receive buffers the other way around.
+// Since the circular buffers are single-producer/single-consumer, none of these need to disable interrupts.
+// Setting UDRIE from the main loop can race with the ISR clearing it, but that only ever results in one extra interrupt that finds the buffer empty.
+
+int uart_set_stream_link(uart_stream stream, uart_link link)
 {
-	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	if (stream >= UART_STREAM_COUNT || link >= UART_LINK_COUNT)
+	{
+		return 1;
+	}
+	stream_links[stream] = link;
+	return 0;
+}
+
+// Enables the transmit data register empty interrupt for a link
+static void start_transmit(uart_link link)
+{
+	if (link == UART_LINK_BT)
+	{
+		UCSR0B |= (1<<UDRIE0);
+	}
+	else
 	{
-		circ_buf_write_str(&debug_send_buf, msg);
-		// Enable the transmit data register empty interrupt
 		UCSR1B |= (1<<UDRIE1);
 	}
 }
 
+// Queues a complete frame for transmission on a link. The frame is either queued in full or not at all,
+// so a full buffer can never splice part of one frame onto another.
+// Frames are also refused while the link is changing baud rate or running a throughput test. Those aren't counted as drops,
+// so the drop count only shows frames lost to a full send buffer.
+static int send_link_frame(uart_link link, char* msg, size_t len)
+{
+	if (baud_states[link] == BAUD_DRAINING || baud_states[link] == BAUD_HOLDOFF || test_link == link || test_pending_link == link)
+	{
+		return 1;
+	}
+	if (circ_buf_get_free(&send_bufs[link]) < len)
+	{
+		if (frames_dropped < UINT16_MAX) frames_dropped++;
+		return 1;
+	}
+	
+	circ_buf_write_len(&send_bufs[link], msg, len);
+	start_transmit(link);
+	return 0;
+}
+
+// Queues a complete frame on whichever link carries the stream
+static int send_frame(uart_stream stream, char* msg, size_t len)
+{
+	return send_link_frame(stream_links[stream], msg, len);
+}
+
+static void apply_baud(uart_link link, uint8_t baud_code)
+{
+	const baud_setting_t *setting = &baud_table[baud_code];
+	if (link == UART_LINK_BT)
+	{
+		UBRR0H = (unsigned char)(setting->ubrr >> 8);
+		UBRR0L = (unsigned char)setting->ubrr;
+		if (setting->u2x) UCSR0A |= (1<<U2X0);
+		else UCSR0A &= ~(1<<U2X0);
+	}
+	else
+	{
+		UBRR1H = (unsigned char)(setting->ubrr >> 8);
+		UBRR1L = (unsigned char)setting->ubrr;
+		if (setting->u2x) UCSR1A |= (1<<U2X1);
+		else UCSR1A &= ~(1<<U2X1);
+	}
+}
+
+// Returns 0 if the ack was queued
+static int send_baud_ack(uart_link link, uint8_t baud_code, uint8_t status)
+{
+	char msg[BT_BAUD_ACK_FRAME_LEN];
+	msg[0] = 0xA4;
+	msg[1] = link;
+	msg[2] = baud_code;
+	msg[3] = status;
+	return send_link_frame(link, msg, BT_BAUD_ACK_FRAME_LEN);
+}
+
+int uart_request_baud(uart_link link, uint8_t baud_code)
+{
+	if (link >= UART_LINK_COUNT)
+	{
+		return UART_BAUD_INVALID;
+	}
+	if (baud_code >= UART_BAUD_COUNT)
+	{
+		send_baud_ack(link, baud_code, UART_BAUD_INVALID);
+		return UART_BAUD_INVALID;
+	}
+	if (baud_states[link] != BAUD_IDLE || test_link == link || test_pending_link == link)
+	{
+		send_baud_ack(link, baud_code, UART_BAUD_BUSY);
+		return UART_BAUD_BUSY;
+	}
+	
+	// The ack goes out at the old rate, then nothing else is queued on the link until it has switched.
+	// The host can't follow a change it was never told about, so without room for the ack nothing changes.
+	if (send_baud_ack(link, baud_code, UART_BAUD_ACCEPTED))
+	{
+		return UART_BAUD_BUSY;
+	}
+	previous_baud_codes[link] = baud_codes[link];
+	baud_codes[link] = baud_code;
+	baud_states[link] = BAUD_DRAINING;
+	return UART_BAUD_ACCEPTED;
+}
+
+int uart_confirm_baud(uart_link link)
+{
+	if (link >= UART_LINK_COUNT || baud_states[link] != BAUD_CONFIRMING)
+	{
+		return 1;
+	}
+	
+	baud_states[link] = BAUD_IDLE;
+	char msg[BT_BAUD_CONFIRM_FRAME_LEN];
+	msg[0] = 0xA5;
+	msg[1] = link;
+	msg[2] = baud_codes[link];
+	send_link_frame(link, msg, BT_BAUD_CONFIRM_FRAME_LEN);
+	return 0;
+}
+
+int uart_start_throughput_test(uart_link link, uint8_t seconds)
+{
+	if (link >= UART_LINK_COUNT || seconds == 0 || seconds > UART_TEST_MAX_SECONDS)
+	{
+		return 1;
+	}
+	if (test_link != TEST_LINK_NONE || test_pending_link != TEST_LINK_NONE || baud_states[link] != BAUD_IDLE)
+	{
+		return 1;
+	}
+	
+	// Wait for anything already queued to go out first so the pattern doesn't cut a frame in half
+	test_pending_link = link;
+	test_tick_rate = get_control_tick_rate();
+	test_ticks_total = (uint16_t)seconds * test_tick_rate;
+	return 0;
+}
+
+static void update_baud_change(uart_link link)
+{
+	switch (baud_states[link])
+	{
+	case BAUD_DRAINING:
+		if (circ_buf_get_len(&send_bufs[link]) == 0)
+		{
+			// The ISR has handed the last byte to the hardware, but up to two characters (data register and shift register) may still be going out.
+			// Wait at least that long at the old rate, plus a tick of margin since we may be partway through the current one.
+			baud_ticks[link] = (uint16_t)((20UL * get_control_tick_rate()) / baud_table[previous_baud_codes[link]].baud) + 2;
+			baud_states[link] = BAUD_HOLDOFF;
+		}
+		break;
+	case BAUD_HOLDOFF:
+		if (--baud_ticks[link] == 0)
+		{
+			apply_baud(link, baud_codes[link]);
+			baud_ticks[link] = UART_BAUD_CONFIRM_SECONDS * get_control_tick_rate();
+			baud_states[link] = BAUD_CONFIRMING;
+		}
+		break;
+	case BAUD_CONFIRMING:
+		if (--baud_ticks[link] == 0)
+		{
+			// The host never confirmed, so it probably can't hear us at the new rate. Go back to the old one.
+			baud_codes[link] = previous_baud_codes[link];
+			apply_baud(link, baud_codes[link]);
+			baud_states[link] = BAUD_IDLE;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+static void update_throughput_test(void)
+{
+	if (test_pending_link != TEST_LINK_NONE)
+	{
+		uint8_t link = test_pending_link;
+		if (circ_buf_get_len(&send_bufs[link]) == 0)
+		{
+			test_bytes = 0;
+			test_pattern = 0;
+			rx_errors[link] = 0;
+			test_ticks_left = test_ticks_total;
+			test_pending_link = TEST_LINK_NONE;
+			test_link = link;
+			start_transmit(link);
+		}
+		return;
+	}
+	
+	if (test_link == TEST_LINK_NONE || --test_ticks_left != 0)
+	{
+		return;
+	}
+	
+	// Test over. Once test_link is cleared the ISR goes back to the (empty) send buffer and turns itself off.
+	uint8_t link = test_link;
+	test_link = TEST_LINK_NONE;
+	
+	uint32_t bytes;
+	uint16_t errors;
+	PROFILED_ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		bytes = test_bytes;
+		errors = rx_errors[link];
+	}
+	uint32_t bytes_per_second = bytes * test_tick_rate / test_ticks_total;
+	
+	char msg[BT_THROUGHPUT_FRAME_LEN];
+	msg[0] = 0xA6;
+	msg[1] = link;
+	msg[2] = baud_codes[link];
+	msg[3] = (char)(bytes_per_second >> 24);
+	msg[4] = (char)(bytes_per_second >> 16);
+	msg[5] = (char)(bytes_per_second >> 8);
+	msg[6] = (char)bytes_per_second;
+	msg[7] = (char)(errors >> 8);
+	msg[8] = (char)errors;
+	send_link_frame(link, msg, BT_THROUGHPUT_FRAME_LEN);
+}
+
+void uart_tick(void)
+{
+	for (uint8_t link = 0; link < UART_LINK_COUNT; link++)
+	{
+		update_baud_change(link);
+	}
+	update_throughput_test();
+}
+
+int debug_send(char* msg)
+{
+	return send_frame(UART_STREAM_DEBUG, msg, strlen(msg));
+}
+
 size_t debug_recv(char* dest, size_t dest_len)
 {
-	size_t bytes_read;
-	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	return uart_recv(stream_links[UART_STREAM_DEBUG], dest, dest_len);
+}
+
+size_t uart_recv(uart_link link, char* dest, size_t dest_len)
+{
+	if (link >= UART_LINK_COUNT)
 	{
-		bytes_read = circ_buf_read(&debug_recv_buf, dest, dest_len);
+		return 0;
 	}
-	return bytes_read;
+	return circ_buf_read(&recv_bufs[link], dest, dest_len);
 }
 
-void bt_send_motor_warning(motor motor_num)
+size_t bt_get_send_free(void)
 {
-	char msg[2];
+	return circ_buf_get_free(&send_bufs[stream_links[UART_STREAM_PROTOCOL]]);
+}
+
+uint16_t bt_get_frames_dropped(void)
+{
+	return frames_dropped;
+}
+
+int bt_send_motor_warning(motor motor_num)
+{
+	char msg[BT_MOTOR_WARNING_FRAME_LEN];
 	msg[0] = 0xA1;
 	msg[1] = motor_num;
-	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-	{
-		circ_buf_write_len(&debug_send_buf, msg, 2);
-		UCSR1B |= (1<<UDRIE1);
-	}
+	return send_frame(UART_STREAM_PROTOCOL, msg, BT_MOTOR_WARNING_FRAME_LEN);
 }
 
-void bt_send_reading(potentiometer pot_num, int16_t reading)
+int bt_send_reading(potentiometer pot_num, int16_t reading)
 {
-	char msg[4];
+	char msg[BT_READING_FRAME_LEN];
 	msg[0] = 0x81;
 	msg[1] = pot_num;
 	msg[2] = (char)(reading >> 8);
 	msg[3] = (char)reading;
-	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	return send_frame(UART_STREAM_PROTOCOL, msg, BT_READING_FRAME_LEN);
+}
+
+int bt_send_tick_overruns(uint16_t overruns)
+{
+	char msg[BT_TICK_OVERRUNS_FRAME_LEN];
+	msg[0] = 0xA2;
+	msg[1] = (char)(overruns >> 8);
+	msg[2] = (char)overruns;
+	return send_frame(UART_STREAM_PROTOCOL, msg, BT_TICK_OVERRUNS_FRAME_LEN);
+}
+
+int bt_send_frames_dropped(uint16_t dropped)
+{
+	char msg[BT_FRAMES_DROPPED_FRAME_LEN];
+	msg[0] = 0xA3;
+	msg[1] = (char)(dropped >> 8);
+	msg[2] = (char)dropped;
+	return send_frame(UART_STREAM_PROTOCOL, msg, BT_FRAMES_DROPPED_FRAME_LEN);
+}
+
+int bt_send_spi_clock(uint8_t divider)
+{
+	char msg[BT_SPI_CLOCK_FRAME_LEN];
+	uint16_t khz = (uint16_t)(F_CPU / 1000 / divider);
+	msg[0] = 0xA8;
+	msg[1] = divider;
+	msg[2] = (char)(khz >> 8);
+	msg[3] = (char)khz;
+	return send_frame(UART_STREAM_PROTOCOL, msg, BT_SPI_CLOCK_FRAME_LEN);
+}
+
+int bt_send_boot_time(uint16_t ms, bool settled)
+{
+	char msg[BT_BOOT_TIME_FRAME_LEN];
+	msg[0] = 0xA9;
+	msg[1] = (char)(ms >> 8);
+	msg[2] = (char)ms;
+	msg[3] = settled ? 1 : 0;
+	return send_frame(UART_STREAM_PROTOCOL, msg, BT_BOOT_TIME_FRAME_LEN);
+}
+
+int bt_send_calibration_status(uint8_t action, bool success, bool calibrated)
+{
+	char msg[BT_CALIBRATION_FRAME_LEN];
+	msg[0] = 0xAA;
+	msg[1] = action;
+	msg[2] = success ? 1 : 0;
+	msg[3] = calibrated ? 1 : 0;
+	return send_frame(UART_STREAM_PROTOCOL, msg, BT_CALIBRATION_FRAME_LEN);
+}
+
+int bt_send_curve_status(uint8_t action, uint8_t motor_num, bool success)
+{
+	char msg[BT_CURVE_FRAME_LEN];
+	msg[0] = 0xAD;
+	msg[1] = action;
+	msg[2] = motor_num;
+	msg[3] = success ? 1 : 0;
+	return send_frame(UART_STREAM_PROTOCOL, msg, BT_CURVE_FRAME_LEN);
+}
+
+// Packs 10 bit values back to back into out, MSB first. The last byte is padded with zeros.
+// Returns the number of bytes written to out.
+static size_t pack_10bit(const uint16_t* values, uint8_t count, char* out)
+{
+	size_t len = 0;
+	uint16_t acc = 0;
+	uint8_t bits = 0;
+	for (uint8_t i = 0; i < count; i++)
 	{
-		circ_buf_write_len(&debug_send_buf, msg, 4);
-		UCSR1B |= (1<<UDRIE1);
+		// Shift in the top 2 bits and the bottom 8 bits separately, flushing whole bytes after each, so the accumulator never needs more than 16 bits
+		acc = (acc << 2) | ((values[i] >> 8) & 0x03);
+		bits += 2;
+		if (bits >= 8)
+		{
+			bits -= 8;
+			out[len++] = (char)(acc >> bits);
+		}
+		acc = (acc << 8) | (values[i] & 0xFF);
+		out[len++] = (char)(acc >> bits);
+	}
+	if (bits > 0)
+	{
+		out[len++] = (char)(acc << (8 - bits));
 	}
+	return len;
 }
 
-// Fires when transmit data register is empty, indicating we can pump in the next byte
-ISR(USART1_UDRE_vect)
+// Converts the filter outputs of a scan back to 10 bit values, pots first followed by motors.
+static void get_channel_values(adc_readings_t *readings, uint16_t* values)
+{
+	for (uint8_t i = 0; i < POT_COUNT; i++)
+	{
+		values[i] = readings->potentiometers[i] >> POT_FILTER_SHIFT;
+	}
+	for (uint8_t i = 0; i < MOTOR_COUNT; i++)
+	{
+		values[POT_COUNT + i] = readings->motors[i] >> POT_FILTER_SHIFT;
+	}
+}
+
+// Appends the XOR of msg[0..len-2] as the last byte of msg.
+static void set_checksum(char* msg, size_t len)
+{
+	char checksum = 0;
+	for (size_t i = 0; i < len - 1; i++)
+	{
+		checksum ^= msg[i];
+	}
+	msg[len - 1] = checksum;
+}
+
+int bt_send_profile(uint8_t page)
+{
+	profile_slot first;
+	uint8_t count = get_profile_page(page, &first);
+	if (count == 0)
+	{
+		return 1;
+	}
+	
+	uint16_t irq_off_max = get_profile_irq_off_max();
+	
+	char msg[BT_PROFILE_MAX_FRAME_LEN];
+	msg[0] = 0xA7;
+	msg[1] = page;
+	msg[2] = (char)(irq_off_max >> 8);
+	msg[3] = (char)irq_off_max;
+	msg[4] = count;
+	size_t len = 5;
+	for (uint8_t i = 0; i < count; i++)
+	{
+		profile_summary_t summary;
+		get_profile_summary(first + i, &summary);
+		msg[len++] = (char)(summary.min >> 8);
+		msg[len++] = (char)summary.min;
+		msg[len++] = (char)(summary.max >> 8);
+		msg[len++] = (char)summary.max;
+		msg[len++] = (char)(summary.mean >> 8);
+		msg[len++] = (char)summary.mean;
+	}
+	len++;
+	set_checksum(msg, len);
+	return send_frame(UART_STREAM_PROTOCOL, msg, len);
+}
+
+int bt_send_finger_poses(const finger_pose_t *poses)
+{
+	char msg[BT_POSE_FRAME_LEN];
+	msg[0] = 0xAB;
+	size_t len = 1;
+	for (uint8_t i = 0; i < MOTOR_COUNT; i++)
+	{
+		msg[len++] = (char)(poses[i].flexion >> 8);
+		msg[len++] = (char)poses[i].flexion;
+		msg[len++] = (char)(poses[i].tip_x >> 8);
+		msg[len++] = (char)poses[i].tip_x;
+		msg[len++] = (char)(poses[i].tip_y >> 8);
+		msg[len++] = (char)poses[i].tip_y;
+	}
+	set_checksum(msg, BT_POSE_FRAME_LEN);
+	return send_frame(UART_STREAM_PROTOCOL, msg, BT_POSE_FRAME_LEN);
+}
+
+int bt_send_repetition(const rep_summary_t *rep)
+{
+	char msg[BT_REPETITION_FRAME_LEN];
+	msg[0] = 0xAC;
+	msg[1] = rep->finger;
+	msg[2] = (char)(rep->number >> 8);
+	msg[3] = (char)rep->number;
+	msg[4] = (char)(rep->rom >> 8);
+	msg[5] = (char)rep->rom;
+	msg[6] = (char)(rep->peak >> 8);
+	msg[7] = (char)rep->peak;
+	msg[8] = (char)(rep->duration_ms >> 8);
+	msg[9] = (char)rep->duration_ms;
+	msg[10] = (char)(rep->resisted_ms >> 8);
+	msg[11] = (char)rep->resisted_ms;
+	set_checksum(msg, BT_REPETITION_FRAME_LEN);
+	return send_frame(UART_STREAM_PROTOCOL, msg, BT_REPETITION_FRAME_LEN);
+}
+
+static int send_snapshot_values(const uint16_t* values)
+{
+	char msg[BT_SNAPSHOT_FRAME_LEN];
+	msg[0] = 0x83;
+	msg[1] = snapshot_seq;
+	pack_10bit(values, POT_COUNT + MOTOR_COUNT, &msg[2]);
+	set_checksum(msg, BT_SNAPSHOT_FRAME_LEN);
+	
+	if (send_frame(UART_STREAM_PROTOCOL, msg, BT_SNAPSHOT_FRAME_LEN))
+	{
+		return 1;
+	}
+	
+	snapshot_seq++;
+	memcpy(delta_ref, values, sizeof(delta_ref));
+	frames_since_keyframe = 1;
+	return 0;
+}
+
+// Returns 0 if the frame was queued, 1 if it was dropped, or 2 if a channel moved too far to encode and a keyframe is needed instead.
+static int send_delta_values(const uint16_t* values)
 {
-	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	char msg[BT_DELTA_MAX_FRAME_LEN];
+	msg[0] = 0x84;
+	msg[1] = snapshot_seq;
+	msg[2] = 0;
+	msg[3] = 0;
+	msg[4] = 0;
+	
+	size_t len = 5;
+	bool half_byte = false;
+	for (uint8_t i = 0; i < POT_COUNT + MOTOR_COUNT; i++)
 	{
-		// Check if there's a byte to send; if there is then copy it into the data register
-		char temp;
-		size_t bytes_read = circ_buf_read(&debug_send_buf, &temp, 1);
-		if (bytes_read == 1)
+		int16_t delta = (int16_t)(values[i] - delta_ref[i]);
+		if (delta == 0) continue;
+		if (delta < BT_DELTA_MIN || delta > BT_DELTA_MAX) return 2;
+		
+		// Mark the channel as changed and append its delta as a 4 bit two's complement nibble, high nibble first
+		msg[2 + (i >> 3)] |= 0x80 >> (i & 7);
+		if (half_byte)
 		{
-			UDR1 = temp;
+			msg[len - 1] |= delta & 0x0F;
 		}
-		
-		// Disable this interrupt if there's no more data in the buffer, otherwise this ISR will keep getting called forever
-		if (circ_buf_get_len(&debug_send_buf) == 0)
+		else
+		{
+			msg[len++] = (char)((delta & 0x0F) << 4);
+		}
+		half_byte = !half_byte;
+	}
+	len++;
+	set_checksum(msg, len);
+	
+	if (send_frame(UART_STREAM_PROTOCOL, msg, len))
+	{
+		return 1;
+	}
+	
+	snapshot_seq++;
+	memcpy(delta_ref, values, sizeof(delta_ref));
+	frames_since_keyframe++;
+	return 0;
+}
+
+int bt_send_snapshot(adc_readings_t *readings)
+{
+	uint16_t values[POT_COUNT + MOTOR_COUNT];
+	get_channel_values(readings, values);
+	return send_snapshot_values(values);
+}
+
+void bt_set_compressed_telemetry(bool enabled)
+{
+	compressed_telemetry = enabled;
+	// Make sure the app has a reference to apply deltas to
+	frames_since_keyframe = 0;
+}
+
+int bt_send_telemetry(adc_readings_t *readings)
+{
+	uint16_t values[POT_COUNT + MOTOR_COUNT];
+	get_channel_values(readings, values);
+	
+	if (compressed_telemetry && frames_since_keyframe != 0 && frames_since_keyframe < BT_KEYFRAME_INTERVAL)
+	{
+		int result = send_delta_values(values);
+		if (result != 2)
 		{
-			UCSR1B &= ~(1<<UDRIE1);
+			return result;
 		}
-	}	
+	}
+	return send_snapshot_values(values);
+}
+
+// Shared body of the UDRE ISRs. Inlined into each one so the register addresses are constants.
+static inline void transmit_next(uart_link link, volatile circular_buffer_t *buf, volatile uint8_t *ucsrb, uint8_t udrie)
+{
+	// During a throughput test, keep the transmitter saturated with the test pattern
+	if (test_link == link)
+	{
+		hal_uart_write(link, test_pattern++);
+		test_bytes++;
+		return;
+	}
+	
+	// Check if there's a byte to send; if there is then copy it into the data register
+	char *span;
+	if (circ_buf_get_read_span(buf, &span) > 0)
+	{
+		hal_uart_write(link, *span);
+		circ_buf_consume(buf, 1);
+	}
+	
+	// Disable this interrupt if there's no more data in the buffer, otherwise this ISR will keep getting called forever
+	if (circ_buf_get_len(buf) == 0)
+	{
+		*ucsrb &= ~(1<<udrie);
+	}
+}
+
+// Shared body of the RX ISRs
+static inline void receive_next(uart_link link, volatile circular_buffer_t *buf, volatile uint8_t *ucsra)
+{
+	// The error flags are only valid until the data register is read. The bit positions are the same for both USARTs.
+	if (*ucsra & ((1<<FE0) | (1<<DOR0) | (1<<UPE0)))
+	{
+		if (rx_errors[link] < UINT16_MAX) rx_errors[link]++;
+	}
+	
+	// Copy the incoming byte out of the data register. It has to be read even if the buffer is full, otherwise this ISR keeps firing.
+	char temp = hal_uart_read(link);
+	
+	// Write the incoming byte into the receive buffer, dropping it if the main loop has fallen behind
+	char *span;
+	if (circ_buf_get_write_span(buf, &span) > 0)
+	{
+		*span = temp;
+		circ_buf_commit_write(buf, 1);
+	}
+}
+
+// Fires when transmit data register is empty, indicating we can pump in the next byte
+ISR(USART0_UDRE_vect)
+{
+	uint16_t start = profile_now_irq_off();
+	transmit_next(UART_LINK_BT, &send_bufs[UART_LINK_BT], &UCSR0B, UDRIE0);
+	profile_record_isr(PROFILE_ISR_USART0_UDRE, start);
 }
 
 // Fires when the receive data register is full, indicating we can read in an incoming byte
+ISR(USART0_RX_vect)
+{
+	uint16_t start = profile_now_irq_off();
+	receive_next(UART_LINK_BT, &recv_bufs[UART_LINK_BT], &UCSR0A);
+	profile_record_isr(PROFILE_ISR_USART0_RX, start);
+}
+
+ISR(USART1_UDRE_vect)
+{
+	uint16_t start = profile_now_irq_off();
+	transmit_next(UART_LINK_DEBUG, &send_bufs[UART_LINK_DEBUG], &UCSR1B, UDRIE1);
+	profile_record_isr(PROFILE_ISR_USART1_UDRE, start);
+}
+
 ISR(USART1_RX_vect)
 {
-	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-	{
-		// Copy the incoming byte out of the data register
-		char temp;
-		temp = UDR1;
-		
-		// Write the incoming byte into the receive buffer
-		circ_buf_write_len(&debug_recv_buf, &temp, 1);
-	}
-}
-
-//ISR(USART0_UDRE_vect)
-//{
-	//ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-	//{
-		//// Check if there's a byte to send; if there is then copy it into the data register
-		//char temp;
-		//size_t bytes_read = circ_buf_read(&bt_send_buf, &temp, 1);
-		//if (bytes_read == 1)
-		//{
-			//UDR0 = temp;
-		//}
-		//
-		//// Disable this interrupt if there's no more data in the buffer, otherwise this ISR will keep getting called forever
-		//if (circ_buf_get_len(&bt_send_buf) == 0)
-		//{
-			//UCSR0B &= ~(1<<UDRIE0);
-		//}
-	//}
-//}
-//
-//// Fires when the receive data register is full, indicating we can read in an incoming byte
-//ISR(USART0_RX_vect)
-//{
-	//ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-	//{
-		//// Copy the incoming byte out of the data register into a null terminated string
-		//char temp[2] = {0, 0};
-		//temp[0] = UDR0;
-		//
-		//// Write the incoming byte into the receive buffer
-		//circ_buf_write(&bt_recv_buf, temp);
-	//}
-//}
\ No newline at end of file
+	uint16_t start = profile_now_irq_off();
+	receive_next(UART_LINK_DEBUG, &recv_bufs[UART_LINK_DEBUG], &UCSR1A);
+	profile_record_isr(PROFILE_ISR_USART1_RX, start);
+}
@@ -11,27 +11,161 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "glove_enums.h"
+#include "spi.h"
+#include "motor.h"
+#include "control_tick.h"
+#include "profiler.h"
+#include "kinematics.h"
+#include "repetition.h"
+
+// Total length in bytes of each frame sent to the app, including the leading frame type byte.
+#define BT_MOTOR_WARNING_FRAME_LEN 2
+#define BT_READING_FRAME_LEN 4
+#define BT_TICK_OVERRUNS_FRAME_LEN 3
+#define BT_FRAMES_DROPPED_FRAME_LEN 3
+#define BT_BAUD_ACK_FRAME_LEN 4
+#define BT_BAUD_CONFIRM_FRAME_LEN 3
+#define BT_THROUGHPUT_FRAME_LEN 9
+#define BT_SPI_CLOCK_FRAME_LEN 4
+#define BT_BOOT_TIME_FRAME_LEN 4
+#define BT_CALIBRATION_FRAME_LEN 4
+#define BT_CURVE_FRAME_LEN 4
+// Finger poses: type, flexion, fingertip x and y of every finger, checksum
+#define BT_POSE_FRAME_LEN (1 + MOTOR_COUNT * 6 + 1)
+// Rep summary: type, finger, rep number, range of motion, peak, duration, time resisted, checksum
+#define BT_REPETITION_FRAME_LEN (2 + 5 * 2 + 1)
+// Snapshot: type, sequence number, 19 channels packed at 10 bits each (padded to a whole 4 channel group), checksum
+#define BT_SNAPSHOT_PACKED_LEN 24
+#define BT_SNAPSHOT_FRAME_LEN (2 + BT_SNAPSHOT_PACKED_LEN + 1)
+// Delta: type, sequence number, 3 byte changed channel bitmap, up to 19 packed 4 bit deltas, checksum
+#define BT_DELTA_MAX_FRAME_LEN (2 + 3 + 10 + 1)
+// Profile: type, page, interrupt-off high-water mark, slot count, min/max/mean per slot, checksum
+#define BT_PROFILE_MAX_FRAME_LEN (5 + PROFILE_MAX_PAGE_SLOTS * 6 + 1)
+
+// Range of a channel change that fits in a delta frame. Anything larger forces a keyframe.
+#define BT_DELTA_MIN -8
+#define BT_DELTA_MAX 7
+// When compressed telemetry is enabled, a full snapshot is sent as a keyframe at least once every this many frames.
+#define BT_KEYFRAME_INTERVAL 32
+
+// The two physical serial links
+typedef enum
+{
+	UART_LINK_BT = 0,		// USART0, BM70 Bluetooth module
+	UART_LINK_DEBUG = 1		// USART1, debug serial
+} uart_link;
+
+#define UART_LINK_COUNT 2
+
+// The two kinds of traffic. Each one can be routed to either link at runtime.
+typedef enum
+{
+	UART_STREAM_PROTOCOL = 0,	// Binary frames for the app (all bt_send_* functions)
+	UART_STREAM_DEBUG = 1		// Human readable text (debug_send)
+} uart_stream;
+
+#define UART_STREAM_COUNT 2
+
+// Number of entries in the baud rate table. Baud codes index it:
+// 0 = 9600 (default), 1 = 19200, 2 = 38400, 3 = 57600, 4 = 76800, 5 = 115200, 6 = 250000, 7 = 500000
+#define UART_BAUD_COUNT 8
+
+// Status codes for a baud rate change request
+#define UART_BAUD_ACCEPTED 0
+#define UART_BAUD_INVALID 1
+#define UART_BAUD_BUSY 2
+
+// How long the host has to confirm a new baud rate before the link falls back to the old one
+#define UART_BAUD_CONFIRM_SECONDS 1
+
+// Longest allowed throughput test
+#define UART_TEST_MAX_SECONDS 60
 
 /**
  * \brief Initializes UART0 and UART1. Must be called during startup.
+ * By default the protocol stream goes to Bluetooth and the debug stream to the debug UART.
  * 
  * \return void
  */
 void setup_uart(void);
 
 /**
- * \brief Transmits an array of characters over the debug UART.
+ * \brief Selects which link a stream is sent on. Both streams may share a link.
+ * Frames already queued on the old link are still sent there.
  * 
- * \param msg A null-terminated string to transmit.
+ * \param stream The stream to route.
+ * \param link The link to send it on.
+ * 
+ * \return int 0 if the operation was successful. Nonzero indicates an argument out of range.
+ */
+int uart_set_stream_link(uart_stream stream, uart_link link);
+
+/**
+ * \brief Advances baud rate changes and throughput tests. Must be called once per control tick.
  * 
  * \return void
  */
-void debug_send(char* msg);
+void uart_tick(void);
 
 /**
- * \brief Receives up to a given number of characters over the debug UART. Returns early if there isn't enough data to read, does NOT block until data comes in.
+ * \brief Starts changing the baud rate of a link. A 0xA4 ack (link, baud code, status) is sent on that link at the current rate.
+ * If accepted, the link switches once the ack has been sent. The host must then switch too and call back with uart_confirm_baud()
+ * within UART_BAUD_CONFIRM_SECONDS, otherwise the link goes back to its previous rate so a failed change can't lose the connection.
+ * If the ack can't be queued the rate isn't changed and UART_BAUD_BUSY is returned, so the host sees no reply and can ask again.
+ * 
+ * \param link The link to change.
+ * \param baud_code The index of the new rate, less than UART_BAUD_COUNT.
+ * 
+ * \return int UART_BAUD_ACCEPTED, UART_BAUD_INVALID or UART_BAUD_BUSY.
+ */
+int uart_request_baud(uart_link link, uint8_t baud_code);
+
+/**
+ * \brief Confirms that the host can hear a link at its new baud rate and makes the change permanent. A 0xA5 frame (link, baud code) is sent at the new rate.
+ * 
+ * \param link The link that was changed.
+ * 
+ * \return int 0 if the operation was successful. Nonzero indicates the link wasn't waiting for confirmation.
+ */
+int uart_confirm_baud(uart_link link);
+
+/**
+ * \brief Saturates a link's transmitter with an incrementing byte pattern (0x00, 0x01, ... wrapping) for a fixed time.
+ * Afterwards a 0xA6 frame is sent on that link with the link, baud code, achieved bytes per second (32 bits) and the number of receive errors during the test (16 bits).
+ * The host can count pattern discontinuities on its side to find transmit errors. Other frames for the link are dropped during the test.
+ * 
+ * \param link The link to test.
+ * \param seconds The length of the test, 1 to UART_TEST_MAX_SECONDS.
+ * 
+ * \return int 0 if the test was started. Nonzero indicates an argument out of range or a test or baud change already in progress.
+ */
+int uart_start_throughput_test(uart_link link, uint8_t seconds);
+
+/**
+ * \brief Receives up to a given number of characters from a particular link. Returns early if there isn't enough data to read, does NOT block until data comes in.
+ * 
+ * \param link The link to receive from.
+ * \param dest The destination array for the received data.
+ * \param dest_len The maximum number of bytes to receive.
+ * 
+ * \return size_t The actual number of bytes received.
+ */
+size_t uart_recv(uart_link link, char* dest, size_t dest_len);
+
+/**
+ * \brief Transmits an array of characters on the link carrying the debug stream. The message is dropped entirely if it doesn't fit in the send buffer.
+ * 
+ * \param msg A null-terminated string to transmit.
+ * 
+ * \return int 0 if the message was queued. Nonzero indicates it was dropped.
+ */
+int debug_send(char* msg);
+
+/**
+ * \brief Receives up to a given number of characters from the link carrying the debug stream. Returns early if there isn't enough data to read, does NOT block until data comes in.
  * 
  * \param dest The destination array for the received data.
  * \param dest_len The maximum number of bytes to receive.
@@ -40,8 +174,143 @@ void debug_send(char* msg);
  */
 size_t debug_recv(char* dest, size_t dest_len);
 
-void bt_send_motor_warning(motor motor_num);
+/**
+ * \brief Returns the space left in the send buffer of the link carrying the protocol stream. Use this to decide how many frames to send in one iteration.
+ * 
+ * \return size_t The number of bytes that can be queued without dropping a frame.
+ */
+size_t bt_get_send_free(void);
+
+/**
+ * \brief Returns the number of frames that have been dropped because the send buffer was full.
+ * Frames refused while a link is changing baud rate or running a throughput test aren't counted.
+ * 
+ * \return uint16_t The drop count. Saturates instead of wrapping.
+ */
+uint16_t bt_get_frames_dropped(void);
+
+// Each of the bt_send_* functions below queues one complete frame on the link carrying the protocol stream.
+// They return 0 if the frame was queued, or nonzero if the send buffer was full and the whole frame was dropped.
+
+int bt_send_motor_warning(motor motor_num);
 
-void bt_send_reading(potentiometer pot_num, int16_t reading);
+int bt_send_reading(potentiometer pot_num, int16_t reading);
+
+int bt_send_tick_overruns(uint16_t overruns);
+
+int bt_send_frames_dropped(uint16_t dropped);
+
+/**
+ * \brief Reports the SPI1 clock picked by calibrate_spi_clock(). The frame is the type, the clock divider and the clock in kHz (big-endian).
+ * 
+ * \param divider F_CPU / SPI clock.
+ * 
+ * \return int 0 if the frame was queued. Nonzero indicates it was dropped.
+ */
+int bt_send_spi_clock(uint8_t divider);
+
+/**
+ * \brief Reports how long startup took to produce valid readings. The frame is the type, the time in ms (big-endian) and 1 if the
+ * readings had settled or 0 if the warm start gave up waiting for them.
+ * 
+ * \param ms Time from enabling interrupts to the first valid readings.
+ * \param settled Whether the readings settled before the warm start timed out.
+ * 
+ * \return int 0 if the frame was queued. Nonzero indicates it was dropped.
+ */
+int bt_send_boot_time(uint16_t ms, bool settled);
+
+/**
+ * \brief Replies to a calibration command. The frame is the type, the action that was requested, 1 if it succeeded or 0 if it
+ * was rejected, and 1 if a stored calibration is in use or 0 if the defaults are.
+ * 
+ * \param action The action byte of the command.
+ * \param success Whether the action succeeded.
+ * \param calibrated Whether a stored calibration is in use.
+ * 
+ * \return int 0 if the frame was queued. Nonzero indicates it was dropped.
+ */
+int bt_send_calibration_status(uint8_t action, bool success, bool calibrated);
+
+/**
+ * \brief Replies to a resistance curve command. The frame is the type, the action and motor bytes of the command, and 1 if
+ * it succeeded or 0 if it was rejected.
+ * 
+ * \param action The action byte of the command.
+ * \param motor_num The motor byte of the command.
+ * \param success Whether the action succeeded.
+ * 
+ * \return int 0 if the frame was queued. Nonzero indicates it was dropped.
+ */
+int bt_send_curve_status(uint8_t action, uint8_t motor_num, bool success);
+
+/**
+ * \brief Sends the pose of every finger from a single scan in one frame.
+ * The frame is the type, then the total flexion, fingertip x and fingertip y of each finger in motor order, and ends with the
+ * XOR of all preceding bytes. Values are signed and big-endian, in the units of finger_pose_t.
+ * 
+ * \param poses Array of MOTOR_COUNT poses to send.
+ * 
+ * \return int 0 if the frame was queued. Nonzero indicates it was dropped.
+ */
+int bt_send_finger_poses(const finger_pose_t *poses);
+
+/**
+ * \brief Sends the summary of a completed rep. The frame is the type, the finger's motor number, then the rep number,
+ * range of motion, peak flexion, duration and time under resistance, and ends with the XOR of all preceding bytes.
+ * Values are big-endian, in the units of rep_summary_t.
+ * 
+ * \param rep The rep to send.
+ * 
+ * \return int 0 if the frame was queued. Nonzero indicates it was dropped.
+ */
+int bt_send_repetition(const rep_summary_t *rep);
+
+/**
+ * \brief Sends one page of profiler statistics. Page 0 holds the whole loop followed by each loop phase, the later pages hold the ISRs,
+ * in profile_slot order (see get_profile_page()). A loop max of 65535 means at least that many cycles.
+ * The frame is the type, the page number, the interrupt-off high-water mark, the number of slots that follow,
+ * then the min, max and mean cycle count of each slot, and ends with the XOR of all preceding bytes. Multi-byte values are big-endian.
+ * 
+ * \param page The page to send, 0 to PROFILE_PAGE_COUNT - 1.
+ * 
+ * \return int 0 if the frame was queued. Nonzero indicates it was dropped or the page is invalid.
+ */
+int bt_send_profile(uint8_t page);
+
+/**
+ * \brief Sends every pot followed by every motor current from a single scan in one frame.
+ * Each value is the filter output scaled back to 10 bits, packed MSB first with no padding between values.
+ * The frame carries a sequence number that increments on every frame queued so the app can detect lost frames,
+ * and ends with the XOR of all preceding bytes.
+ * 
+ * \param readings The scan to send.
+ * 
+ * \return int 0 if the frame was queued. Nonzero indicates it was dropped.
+ */
+int bt_send_snapshot(adc_readings_t *readings);
+
+/**
+ * \brief Selects between sending a full snapshot frame every time, or mostly sending delta frames against the last values sent.
+ * Enabling compression always starts with a keyframe.
+ * 
+ * \param enabled True to send delta frames.
+ * 
+ * \return void
+ */
+void bt_set_compressed_telemetry(bool enabled);
+
+/**
+ * \brief Sends one telemetry frame for a scan in the currently selected mode. Never needs more than BT_SNAPSHOT_FRAME_LEN bytes of buffer space.
+ * In compressed mode this sends a 0x84 delta frame: sequence number (shared with snapshots), a 19 bit map of channels that changed (MSB of the first byte is pot 0),
+ * then one 4 bit two's complement delta per changed channel in channel order, high nibble first, and the XOR checksum.
+ * A snapshot frame is sent as a keyframe instead every BT_KEYFRAME_INTERVAL frames, or whenever a channel has moved by more than a delta can hold.
+ * If the app sees a gap in the sequence numbers it must ignore delta frames until the next snapshot.
+ * 
+ * \param readings The scan to send.
+ * 
+ * \return int 0 if the frame was queued. Nonzero indicates it was dropped.
+ */
+int bt_send_telemetry(adc_readings_t *readings);
 
 #endif /* UART_H_ */
\ No newline at end of file
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Builds and runs the host tests under the address and undefined behaviour sanitizers.
+# Usage: ./run_tests.sh [seed]
+# Each test is linked with only the firmware sources it needs. Executables go in $BUILD_DIR, outside the tree by default.
+
+cd "$(dirname "$0")"
+SRC=../avr_firmware
+BUILD_DIR=${BUILD_DIR:-${TMPDIR:-/tmp}/glove_tests}
+CC=${CC:-gcc}
+CFLAGS="-std=gnu99 -g -O1 -Wall -Wextra -DHOST_BUILD -funsigned-char -fshort-enums -fsanitize=address,undefined -fno-sanitize-recover=all -I$SRC"
+mkdir -p "$BUILD_DIR"
+
+failed=0
+
+# run_test <test name> <sources...>
+# Sources are looked for in this directory first, then in the firmware's.
+run_test()
+{
+	name=$1
+	shift
+	sources=""
+	for f in "$@"
+	do
+		if [ -f "$f" ]; then sources="$sources $f"; else sources="$sources $SRC/$f"; fi
+	done
+	if ! $CC $CFLAGS -o "$BUILD_DIR/$name" "$name.c" $sources -lm; then
+		echo "$name: build failed"
+		failed=1
+		return
+	fi
+	"$BUILD_DIR/$name" $SEED || failed=1
+}
+
+SEED=$1
+
+run_test test_circular_buffer circular_buffer.c
+run_test test_command command.c
+run_test test_telemetry telemetry_decoder.c uart.c circular_buffer.c profiler.c control_tick.c soft_timer.c hal_host.c
+run_test test_flexion flexion.c
+run_test test_current_control current_control.c
+run_test test_kinematics kinematics.c
+run_test test_repetition repetition.c
+run_test test_resistance_curve resistance_curve.c
+
+exit $failed
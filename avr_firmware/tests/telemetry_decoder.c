@@ -0,0 +1,139 @@
+/*
+ * telemetry_decoder.c
+ *
+ * Created: 2026-10-17
+ */ 
+
+#include "telemetry_decoder.h"
+
+#define MAP_BITS (8 * (TELEMETRY_DELTA_HEADER_LEN - 2))
+
+void telemetry_decoder_init(telemetry_decoder_t* decoder)
+{
+	for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+	{
+		decoder->values[i] = 0;
+	}
+	decoder->synced = false;
+	decoder->started = false;
+	decoder->next_seq = 0;
+	decoder->lost_frames = 0;
+}
+
+static uint8_t count_changed(const uint8_t* map)
+{
+	uint8_t count = 0;
+	for (uint8_t i = 0; i < MAP_BITS; i++)
+	{
+		if (map[i >> 3] & (0x80 >> (i & 7))) count++;
+	}
+	return count;
+}
+
+int telemetry_frame_len(const uint8_t* data, size_t available)
+{
+	if (available == 0) return 0;
+	
+	switch (data[0])
+	{
+		case TELEMETRY_SNAPSHOT_TYPE:
+			return TELEMETRY_SNAPSHOT_LEN;
+		case TELEMETRY_DELTA_TYPE:
+			// Two deltas per byte, so the length depends on how many channels are marked in the map
+			if (available < TELEMETRY_DELTA_HEADER_LEN) return 0;
+			return TELEMETRY_DELTA_HEADER_LEN + (count_changed(&data[2]) + 1) / 2 + 1;
+		default:
+			return -1;
+	}
+}
+
+// The frame ends with the XOR of all the bytes before it, so the XOR of the whole frame is 0
+static bool checksum_ok(const uint8_t* frame, size_t len)
+{
+	uint8_t sum = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		sum ^= frame[i];
+	}
+	return sum == 0;
+}
+
+// Counts the frames missing before seq, and expects the one after it next
+static void note_sequence(telemetry_decoder_t* decoder, uint8_t seq)
+{
+	if (decoder->started)
+	{
+		decoder->lost_frames += (uint8_t)(seq - decoder->next_seq);
+	}
+	decoder->started = true;
+	decoder->next_seq = (uint8_t)(seq + 1);
+}
+
+static void decode_snapshot(telemetry_decoder_t* decoder, const uint8_t* frame)
+{
+	// Values are packed back to back, MSB first
+	const uint8_t* packed = &frame[2];
+	uint16_t bit = 0;
+	for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+	{
+		uint16_t value = 0;
+		for (uint8_t k = 0; k < 10; k++, bit++)
+		{
+			value = (value << 1) | ((packed[bit >> 3] >> (7 - (bit & 7))) & 1);
+		}
+		decoder->values[i] = value;
+	}
+}
+
+static void decode_delta(telemetry_decoder_t* decoder, const uint8_t* frame)
+{
+	const uint8_t* map = &frame[2];
+	const uint8_t* nibbles = &frame[TELEMETRY_DELTA_HEADER_LEN];
+	uint8_t n = 0;
+	for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+	{
+		if (!(map[i >> 3] & (0x80 >> (i & 7)))) continue;
+		
+		// 4 bit two's complement, high nibble first
+		uint8_t nibble = (n & 1) ? nibbles[n >> 1] & 0x0F : nibbles[n >> 1] >> 4;
+		int8_t delta = (nibble & 0x08) ? (int8_t)(nibble - 16) : (int8_t)nibble;
+		decoder->values[i] = (uint16_t)(decoder->values[i] + delta) & 0x3FF;
+		n++;
+	}
+}
+
+telemetry_result telemetry_decode_frame(telemetry_decoder_t* decoder, const uint8_t* frame, size_t len)
+{
+	int expected = telemetry_frame_len(frame, len);
+	if (expected <= 0 || (size_t)expected != len || !checksum_ok(frame, len))
+	{
+		return TELEMETRY_BAD_FRAME;
+	}
+	
+	uint8_t seq = frame[1];
+	if (frame[0] == TELEMETRY_SNAPSHOT_TYPE)
+	{
+		note_sequence(decoder, seq);
+		decode_snapshot(decoder, frame);
+	}
+	else
+	{
+		// Channel bits past the last channel are never set
+		for (uint8_t i = TELEMETRY_CHANNELS; i < MAP_BITS; i++)
+		{
+			if (frame[2 + (i >> 3)] & (0x80 >> (i & 7))) return TELEMETRY_BAD_FRAME;
+		}
+		bool in_sequence = decoder->started && seq == decoder->next_seq;
+		note_sequence(decoder, seq);
+		if (!decoder->synced || !in_sequence)
+		{
+			// The reference is gone until the next snapshot
+			decoder->synced = false;
+			return TELEMETRY_SKIPPED;
+		}
+		decode_delta(decoder, frame);
+	}
+	
+	decoder->synced = true;
+	return TELEMETRY_VALUES;
+}
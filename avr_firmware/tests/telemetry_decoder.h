@@ -0,0 +1,77 @@
+/*
+ * telemetry_decoder.h
+ *
+ * Created: 2026-10-17
+ *
+ * Reference decoder for the 0x83 snapshot and 0x84 delta telemetry frames sent by bt_send_telemetry(), for the app side of
+ * the Bluetooth link. Plain C99 with no firmware headers, so it can be copied into the app as is. The frame formats are
+ * described with bt_send_snapshot() and bt_send_telemetry() in uart.h.
+ */ 
+
+
+#ifndef TELEMETRY_DECODER_H_
+#define TELEMETRY_DECODER_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// 14 pots followed by 5 motors, each a 10 bit value
+#define TELEMETRY_CHANNELS 19
+
+#define TELEMETRY_SNAPSHOT_TYPE 0x83
+#define TELEMETRY_DELTA_TYPE 0x84
+
+// Type, sequence number, 19 packed 10 bit values and the checksum
+#define TELEMETRY_SNAPSHOT_LEN (2 + (TELEMETRY_CHANNELS * 10 + 7) / 8 + 1)
+// Type, sequence number and the 3 byte channel map, before the deltas
+#define TELEMETRY_DELTA_HEADER_LEN 5
+
+typedef enum
+{
+	TELEMETRY_VALUES,			// The frame was applied and values holds the scan it carried
+	TELEMETRY_SKIPPED,			// A delta frame arrived without a reference to apply it to. Values are stale until the next snapshot.
+	TELEMETRY_BAD_FRAME			// Wrong type, length or checksum. Nothing changed.
+} telemetry_result;
+
+typedef struct
+{
+	uint16_t values[TELEMETRY_CHANNELS];	// Latest decoded scan, pots first
+	bool synced;							// values is a valid reference for the next delta frame
+	bool started;							// A frame has been seen, so next_seq is known
+	uint8_t next_seq;						// Sequence number expected next
+	uint32_t lost_frames;					// Frames missing from the sequence numbers seen so far
+} telemetry_decoder_t;
+
+/**
+ * \brief Initializes a decoder. It stays unsynced, skipping delta frames, until the first snapshot.
+ * 
+ * \param decoder The decoder to initialize.
+ * 
+ * \return void
+ */
+void telemetry_decoder_init(telemetry_decoder_t* decoder);
+
+/**
+ * \brief Works out how long the telemetry frame at the start of some received bytes is, so a byte stream can be cut into frames.
+ * 
+ * \param data Received bytes, starting with a frame type.
+ * \param available The number of bytes in data.
+ * 
+ * \return int The frame length. 0 if more bytes are needed to tell, or -1 if data doesn't start with a telemetry frame type.
+ */
+int telemetry_frame_len(const uint8_t* data, size_t available);
+
+/**
+ * \brief Decodes one complete snapshot or delta frame. A snapshot always resynchronizes the decoder. A delta frame is only applied
+ * if its sequence number follows on from the last frame applied, since a lost frame leaves the values it changed unknown.
+ * 
+ * \param decoder The decoder to update.
+ * \param frame The frame, starting with its type byte.
+ * \param len The length of the frame, from telemetry_frame_len().
+ * 
+ * \return telemetry_result Whether values was updated.
+ */
+telemetry_result telemetry_decode_frame(telemetry_decoder_t* decoder, const uint8_t* frame, size_t len);
+
+#endif /* TELEMETRY_DECODER_H_ */
@@ -0,0 +1,61 @@
+/*
+ * test.h
+ *
+ * Created: 2026-10-17
+ *
+ * Tiny helpers shared by the host tests. Every test is its own executable, built and run by run_tests.sh.
+ */ 
+
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static unsigned test_failures;
+
+// Records a failure and carries on, so one run reports every broken check
+#define CHECK(cond) \
+	do \
+	{ \
+		if (!(cond)) \
+		{ \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			test_failures++; \
+		} \
+	} while (0)
+
+// Like CHECK, but prints the two values when they differ
+#define CHECK_EQ(actual, expected) \
+	do \
+	{ \
+		long long a_ = (long long)(actual), e_ = (long long)(expected); \
+		if (a_ != e_) \
+		{ \
+			fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); \
+			test_failures++; \
+		} \
+	} while (0)
+
+// Seed for the randomized tests. Taken from the first argument so a failing run can be repeated.
+static inline unsigned test_seed(int argc, char** argv)
+{
+	unsigned seed = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 0) : 1;
+	srand(seed);
+	return seed;
+}
+
+// Ends a test, returning the exit status for main
+static inline int test_report(const char* name, unsigned seed)
+{
+	if (test_failures)
+	{
+		fprintf(stderr, "%s: %u failed checks (seed %u)\n", name, test_failures, seed);
+		return 1;
+	}
+	printf("%s: ok\n", name);
+	return 0;
+}
+
+#endif /* TEST_H_ */
@@ -0,0 +1,248 @@
+/*
+ * test_circular_buffer.c
+ *
+ * Created: 2026-10-17
+ *
+ * Directed tests of the edge cases (empty, full, wrapping around the end of the array and the 8 bit indices wrapping at 256),
+ * then a fuzzer that runs random mixes of copying and span operations, checking every byte and length against a plain array
+ * that holds what the buffer should contain.
+ */ 
+
+#include <string.h>
+
+#include "circular_buffer.h"
+#include "test.h"
+
+// Reference model: the bytes the buffer should hold, oldest first
+static char model[BUF_SIZE];
+static size_t model_len;
+
+static void model_push(const char* data, size_t len)
+{
+	memcpy(&model[model_len], data, len);
+	model_len += len;
+}
+
+static void model_pop(char* out, size_t len)
+{
+	if (out) memcpy(out, model, len);
+	memmove(model, &model[len], model_len - len);
+	model_len -= len;
+}
+
+static char next_byte;
+
+static void random_bytes(char* data, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		data[i] = next_byte++;
+	}
+}
+
+static void random_op(volatile circular_buffer_t* buf)
+{
+	char data[BUF_SIZE + 8];
+	char out[BUF_SIZE + 8];
+	size_t want = (size_t)(rand() % (BUF_SIZE + 8));
+	
+	switch (rand() % 4)
+	{
+		case 0:
+		{
+			// Writes that don't fit are cut short
+			random_bytes(data, want);
+			size_t written = circ_buf_write_len(buf, data, want);
+			size_t room = BUF_SIZE - model_len;
+			CHECK_EQ(written, want < room ? want : room);
+			model_push(data, written);
+			break;
+		}
+		case 1:
+		{
+			size_t got = circ_buf_read(buf, out, want);
+			CHECK_EQ(got, want < model_len ? want : model_len);
+			CHECK(memcmp(out, model, got) == 0);
+			model_pop(NULL, got);
+			break;
+		}
+		case 2:
+		{
+			char* span;
+			size_t span_len = circ_buf_get_write_span(buf, &span);
+			CHECK(span_len <= BUF_SIZE - model_len);
+			CHECK(span_len > 0 || model_len == BUF_SIZE);
+			size_t len = span_len ? want % (span_len + 1) : 0;
+			random_bytes(data, len);
+			memcpy(span, data, len);
+			circ_buf_commit_write(buf, len);
+			model_push(data, len);
+			break;
+		}
+		case 3:
+		{
+			char* span;
+			size_t span_len = circ_buf_get_read_span(buf, &span);
+			CHECK(span_len <= model_len);
+			CHECK(span_len > 0 || model_len == 0);
+			CHECK(memcmp(span, model, span_len) == 0);
+			size_t len = span_len ? want % (span_len + 1) : 0;
+			circ_buf_consume(buf, len);
+			model_pop(NULL, len);
+			break;
+		}
+	}
+	
+	CHECK_EQ(circ_buf_get_len(buf), model_len);
+	CHECK_EQ(circ_buf_get_free(buf), BUF_SIZE - model_len);
+}
+
+// Moves both indices on by offset without storing anything, as if that many bytes had passed through
+static void advance_indices(volatile circular_buffer_t* buf, uint8_t offset)
+{
+	circ_buf_init(buf);
+	while (offset > 0)
+	{
+		uint8_t step = offset < BUF_SIZE ? offset : BUF_SIZE;
+		circ_buf_commit_write(buf, step);
+		circ_buf_consume(buf, step);
+		offset -= step;
+	}
+}
+
+static void test_empty(void)
+{
+	volatile circular_buffer_t buf;
+	char out[4];
+	char* span;
+	circ_buf_init(&buf);
+	CHECK_EQ(circ_buf_get_len(&buf), 0);
+	CHECK_EQ(circ_buf_get_free(&buf), BUF_SIZE);
+	CHECK_EQ(circ_buf_read(&buf, out, sizeof(out)), 0);
+	CHECK_EQ(circ_buf_get_read_span(&buf, &span), 0);
+	CHECK_EQ(circ_buf_get_write_span(&buf, &span), BUF_SIZE);
+	CHECK(span == buf.buffer);
+}
+
+static void test_full(void)
+{
+	volatile circular_buffer_t buf;
+	char data[BUF_SIZE + 1];
+	char out[BUF_SIZE + 1];
+	char* span;
+	circ_buf_init(&buf);
+	random_bytes(data, sizeof(data));
+	
+	// The whole array is usable, and a write that doesn't fit stops when it's full without overwriting anything
+	CHECK_EQ(circ_buf_write_len(&buf, data, sizeof(data)), BUF_SIZE);
+	CHECK_EQ(circ_buf_get_len(&buf), BUF_SIZE);
+	CHECK_EQ(circ_buf_get_free(&buf), 0);
+	CHECK_EQ(circ_buf_get_write_span(&buf, &span), 0);
+	CHECK_EQ(circ_buf_write_len(&buf, data, 1), 0);
+	CHECK_EQ(circ_buf_write_str(&buf, "x"), 0);
+	CHECK_EQ(circ_buf_get_read_span(&buf, &span), BUF_SIZE);
+	
+	CHECK_EQ(circ_buf_read(&buf, out, sizeof(out)), BUF_SIZE);
+	CHECK(memcmp(out, data, BUF_SIZE) == 0);
+	CHECK_EQ(circ_buf_get_len(&buf), 0);
+}
+
+// Fills and empties the buffer starting from every index value, so the data wraps around the end of the array at every
+// position and the indices wrap from 255 to 0 with the buffer partly and completely full
+static void test_wrap_around(void)
+{
+	for (unsigned offset = 0; offset < 256; offset++)
+	{
+		volatile circular_buffer_t buf;
+		char data[BUF_SIZE];
+		char out[BUF_SIZE];
+		char* span;
+		advance_indices(&buf, (uint8_t)offset);
+		CHECK_EQ(circ_buf_get_len(&buf), 0);
+		
+		// Spans stop at the end of the array
+		size_t to_end = BUF_SIZE - offset % BUF_SIZE;
+		CHECK_EQ(circ_buf_get_write_span(&buf, &span), to_end);
+		CHECK(span == &buf.buffer[offset % BUF_SIZE]);
+		
+		random_bytes(data, sizeof(data));
+		CHECK_EQ(circ_buf_write_len(&buf, data, BUF_SIZE), BUF_SIZE);
+		CHECK_EQ(buf.write_idx, (uint8_t)(offset + BUF_SIZE));
+		CHECK_EQ(circ_buf_get_len(&buf), BUF_SIZE);
+		CHECK_EQ(circ_buf_get_free(&buf), 0);
+		CHECK_EQ(circ_buf_get_read_span(&buf, &span), to_end);
+		CHECK(span == &buf.buffer[offset % BUF_SIZE]);
+		
+		// Read back in two uneven pieces
+		size_t first = offset % 7 + 1;
+		CHECK_EQ(circ_buf_read(&buf, out, first), first);
+		CHECK_EQ(circ_buf_get_len(&buf), BUF_SIZE - first);
+		CHECK_EQ(circ_buf_get_free(&buf), first);
+		CHECK_EQ(circ_buf_read(&buf, out + first, BUF_SIZE), BUF_SIZE - first);
+		CHECK(memcmp(out, data, BUF_SIZE) == 0);
+		CHECK_EQ(circ_buf_get_len(&buf), 0);
+		CHECK_EQ(buf.read_idx, buf.write_idx);
+	}
+}
+
+// Writes and reads through the spans by hand, committing and consuming less than was offered
+static void test_partial_spans(void)
+{
+	volatile circular_buffer_t buf;
+	char* span;
+	advance_indices(&buf, 256 - 10);
+	
+	// 10 bytes to the end of the array, commit 4 of them
+	CHECK_EQ(circ_buf_get_write_span(&buf, &span), 10);
+	memcpy(span, "abcdefghij", 10);
+	circ_buf_commit_write(&buf, 4);
+	CHECK_EQ(circ_buf_get_len(&buf), 4);
+	
+	// The rest of the span is still there, then the array wraps to the start while write_idx wraps past 255
+	CHECK_EQ(circ_buf_get_write_span(&buf, &span), 6);
+	memcpy(span, "efghij", 6);
+	circ_buf_commit_write(&buf, 6);
+	CHECK_EQ(buf.write_idx, 0);
+	CHECK_EQ(circ_buf_get_write_span(&buf, &span), BUF_SIZE - 10);
+	CHECK(span == buf.buffer);
+	memcpy(span, "klm", 3);
+	circ_buf_commit_write(&buf, 3);
+	CHECK_EQ(circ_buf_get_len(&buf), 13);
+	
+	// read_idx is numerically above write_idx now, but the length still comes out right
+	CHECK(buf.read_idx > buf.write_idx);
+	CHECK_EQ(circ_buf_get_read_span(&buf, &span), 10);
+	CHECK(memcmp(span, "abcdefghij", 10) == 0);
+	circ_buf_consume(&buf, 7);
+	CHECK_EQ(circ_buf_get_read_span(&buf, &span), 3);
+	CHECK(memcmp(span, "hij", 3) == 0);
+	circ_buf_consume(&buf, 3);
+	CHECK_EQ(circ_buf_get_read_span(&buf, &span), 3);
+	CHECK(memcmp(span, "klm", 3) == 0);
+	
+	// Consuming nothing changes nothing
+	circ_buf_consume(&buf, 0);
+	CHECK_EQ(circ_buf_get_len(&buf), 3);
+	circ_buf_consume(&buf, 3);
+	CHECK_EQ(circ_buf_get_len(&buf), 0);
+	CHECK_EQ(circ_buf_get_free(&buf), BUF_SIZE);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned seed = test_seed(argc, argv);
+	
+	test_empty();
+	test_full();
+	test_wrap_around();
+	test_partial_spans();
+	
+	volatile circular_buffer_t buf;
+	circ_buf_init(&buf);
+	// Enough operations for the free-running indices to wrap many times
+	for (unsigned i = 0; i < 200000 && test_failures == 0; i++)
+	{
+		random_op(&buf);
+	}
+	return test_report("test_circular_buffer", seed);
+}
@@ -0,0 +1,365 @@
+/*
+ * test_command.c
+ *
+ * Created: 2026-10-17
+ *
+ * Fuzzes command_parser_feed() with random byte streams cut into random chunks, and checks every command it runs against
+ * a straightforward decode of the whole stream. Then damages well formed commands the ways a radio link does, dropping,
+ * flipping and adding bytes, and checks that only the damaged commands and at most the ones right after them are lost.
+ */ 
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "command.h"
+#include "test.h"
+
+#define STREAM_LEN 4096
+#define MAX_CALLS STREAM_LEN
+
+typedef struct
+{
+	uint8_t opcode;
+	uint8_t args[CMD_MAX_ARGS];
+} call_t;
+
+static call_t calls[MAX_CALLS];
+static size_t call_count;
+
+static void record(uint8_t opcode, const uint8_t* args, uint8_t arg_len)
+{
+	if (call_count == MAX_CALLS)
+	{
+		CHECK(!"more commands ran than bytes were fed");
+		return;
+	}
+	memset(&calls[call_count], 0, sizeof(call_t));
+	calls[call_count].opcode = opcode;
+	memcpy(calls[call_count].args, args, arg_len);
+	call_count++;
+}
+
+// One handler per table entry, so the test knows which command ran
+#define HANDLER(n, opcode, len) static void handler_##n(const uint8_t* args) { record(opcode, args, len); }
+HANDLER(0, 0x01, 0)
+HANDLER(1, 0x82, 1)
+HANDLER(2, 0x85, 2)
+HANDLER(3, 0x90, 5)
+HANDLER(4, 0x93, 1)
+HANDLER(5, 0x95, 6)
+HANDLER(6, 0x99, CMD_MAX_ARGS)
+
+static const command_t table[] =
+{
+	{ 0x01, 0, handler_0 },
+	{ 0x82, 1, handler_1 },
+	{ 0x85, 2, handler_2 },
+	{ 0x90, 5, handler_3 },
+	{ 0x93, 1, handler_4 },
+	{ 0x95, 6, handler_5 },
+	{ 0x99, CMD_MAX_ARGS, handler_6 },
+};
+#define TABLE_LEN (sizeof(table) / sizeof(table[0]))
+
+static const command_t* lookup(uint8_t opcode)
+{
+	for (size_t i = 0; i < TABLE_LEN; i++)
+	{
+		if (table[i].opcode == opcode) return &table[i];
+	}
+	return NULL;
+}
+
+static bool same_call(const call_t* a, const call_t* b)
+{
+	return a->opcode == b->opcode && memcmp(a->args, b->args, lookup(a->opcode)->arg_len) == 0;
+}
+
+// Decodes a whole stream at once the obvious way. Returns the number of commands found.
+static size_t reference_decode(const uint8_t* stream, size_t len, call_t* out)
+{
+	size_t count = 0;
+	bool synced = false;
+	size_t i = 0;
+	while (i < len)
+	{
+		uint8_t byte = stream[i++];
+		if (!synced)
+		{
+			synced = byte == CMD_SYNC;
+			continue;
+		}
+		const command_t* cmd = lookup(byte);
+		synced = cmd == NULL && byte == CMD_SYNC;
+		if (cmd == NULL) continue;
+		if (len - i < cmd->arg_len + 1U) break;
+		
+		uint8_t checksum = byte;
+		for (uint8_t k = 0; k < cmd->arg_len; k++)
+		{
+			checksum ^= stream[i + k];
+		}
+		if (stream[i + cmd->arg_len] == checksum)
+		{
+			memset(&out[count], 0, sizeof(call_t));
+			out[count].opcode = cmd->opcode;
+			memcpy(out[count].args, &stream[i], cmd->arg_len);
+			count++;
+		}
+		else
+		{
+			synced = stream[i + cmd->arg_len] == CMD_SYNC;
+		}
+		i += cmd->arg_len + 1U;
+	}
+	return count;
+}
+
+// Appends a well formed command to stream and returns its length
+static size_t encode(const call_t* call, uint8_t* stream)
+{
+	const command_t* cmd = lookup(call->opcode);
+	size_t len = 0;
+	stream[len++] = CMD_SYNC;
+	stream[len++] = call->opcode;
+	uint8_t checksum = call->opcode;
+	for (uint8_t k = 0; k < cmd->arg_len; k++)
+	{
+		stream[len++] = call->args[k];
+		checksum ^= call->args[k];
+	}
+	stream[len++] = checksum;
+	return len;
+}
+
+static void random_call(call_t* call)
+{
+	memset(call, 0, sizeof(call_t));
+	call->opcode = table[rand() % TABLE_LEN].opcode;
+	for (uint8_t k = 0; k < lookup(call->opcode)->arg_len; k++)
+	{
+		call->args[k] = (uint8_t)rand();
+	}
+}
+
+// Feeds a stream in random pieces, including empty ones, the way UART reads arrive, all within the byte timeout
+static void feed_in_chunks(command_parser_t* parser, const uint8_t* stream, size_t len)
+{
+	size_t fed = 0;
+	uint16_t now_ms = (uint16_t)rand();
+	while (fed < len)
+	{
+		size_t chunk = (size_t)(rand() % 12);
+		if (chunk > len - fed) chunk = len - fed;
+		command_parser_feed(parser, (const char*)&stream[fed], chunk, now_ms);
+		// Only bytes are timed, so an empty read doesn't move the clock on
+		if (chunk > 0) now_ms += (uint16_t)(rand() % (CMD_BYTE_TIMEOUT_MS + 1));
+		fed += chunk;
+		CHECK(parser->arg_count <= CMD_MAX_ARGS);
+	}
+}
+
+// Random bytes, well formed commands and commands with a bad checksum, so every path is taken
+static size_t fill_stream(uint8_t* stream, size_t max_len)
+{
+	size_t len = 0;
+	while (len + CMD_MAX_ARGS + 3 <= max_len)
+	{
+		switch (rand() % 4)
+		{
+			case 0:
+				stream[len++] = (uint8_t)rand();
+				break;
+			case 1:
+				stream[len++] = (rand() % 2) ? CMD_SYNC : table[rand() % TABLE_LEN].opcode;
+				break;
+			default:
+			{
+				call_t call;
+				random_call(&call);
+				size_t n = encode(&call, &stream[len]);
+				if (rand() % 4 == 0) stream[len + n - 1] ^= (uint8_t)(1 + rand() % 255);
+				len += n;
+				break;
+			}
+		}
+	}
+	return len;
+}
+
+static void fuzz_once(void)
+{
+	static uint8_t stream[STREAM_LEN];
+	static call_t expected[MAX_CALLS];
+	size_t len = fill_stream(stream, (size_t)(rand() % STREAM_LEN) + 1);
+	size_t expected_count = reference_decode(stream, len, expected);
+	
+	command_parser_t parser;
+	command_parser_init(&parser, table, TABLE_LEN);
+	call_count = 0;
+	feed_in_chunks(&parser, stream, len);
+	
+	CHECK_EQ(call_count, expected_count);
+	size_t n = call_count < expected_count ? call_count : expected_count;
+	for (size_t i = 0; i < n; i++)
+	{
+		CHECK(same_call(&calls[i], &expected[i]));
+	}
+}
+
+// Sends a run of commands with random gaps between them, damages some, and checks what comes out the other end
+static void damage_once(unsigned* damaged_total, unsigned* lost_total, unsigned* bogus_total)
+{
+	static uint8_t stream[STREAM_LEN];
+	call_t sent[64];
+	size_t len = 0;
+	unsigned damaged = 0;
+	
+	for (size_t k = 0; k < 64; k++)
+	{
+		// Line noise between commands, which never contains a sync byte
+		for (int gap = rand() % 4; gap > 0; gap--)
+		{
+			uint8_t noise = (uint8_t)rand();
+			stream[len++] = noise == CMD_SYNC ? 0 : noise;
+		}
+		
+		random_call(&sent[k]);
+		// Room for one extra byte
+		uint8_t frame[CMD_MAX_ARGS + 4];
+		size_t n = encode(&sent[k], frame);
+		if (rand() % 4 == 0)
+		{
+			size_t at = (size_t)(rand() % n);
+			switch (rand() % 3)
+			{
+				case 0:
+					memmove(&frame[at], &frame[at + 1], n - at - 1);
+					n--;
+					break;
+				case 1:
+					frame[at] ^= (uint8_t)(1 << (rand() % 8));
+					break;
+				case 2:
+					memmove(&frame[at + 1], &frame[at], n - at);
+					frame[at] = (uint8_t)rand();
+					n++;
+					break;
+			}
+			damaged++;
+		}
+		memcpy(&stream[len], frame, n);
+		len += n;
+	}
+	
+	command_parser_t parser;
+	command_parser_init(&parser, table, TABLE_LEN);
+	call_count = 0;
+	feed_in_chunks(&parser, stream, len);
+	
+	// Match what ran against what was sent, in order. Anything that doesn't match was made up out of damaged bytes.
+	size_t next = 0;
+	unsigned bogus = 0;
+	for (size_t i = 0; i < call_count; i++)
+	{
+		size_t k = next;
+		while (k < 64 && !same_call(&calls[i], &sent[k])) k++;
+		if (k == 64)
+		{
+			bogus++;
+			continue;
+		}
+		next = k + 1;
+	}
+	unsigned lost = 64 - (unsigned)(call_count - bogus);
+	
+	// Each damaged command can take the one after it down too, but never more
+	CHECK(lost <= 2 * damaged);
+	*damaged_total += damaged;
+	*lost_total += lost;
+	*bogus_total += bogus;
+}
+
+static void test_damage(void)
+{
+	unsigned damaged = 0;
+	unsigned lost = 0;
+	unsigned bogus = 0;
+	for (unsigned run = 0; run < 500; run++)
+	{
+		damage_once(&damaged, &lost, &bogus);
+	}
+	// A command only runs from damaged bytes if a one byte checksum matches by chance
+	CHECK(bogus <= damaged / 64 + 2);
+	// Most damage costs just the one command
+	CHECK(lost < damaged + damaged / 4);
+}
+
+// The stale byte case: a command whose first bytes arrived but whose rest never did must not
+// swallow the next command's bytes, or run the next command's arguments as opcodes
+static void test_timeout(void)
+{
+	command_parser_t parser;
+	command_parser_init(&parser, table, TABLE_LEN);
+	call_count = 0;
+	
+	// 0x99 takes 8 arguments. Only the opcode gets through, then the link goes quiet.
+	static const char partial[] = { CMD_SYNC, 0x99 };
+	command_parser_feed(&parser, partial, sizeof(partial), 1000);
+	static const char save[] = { CMD_SYNC, 0x93, 0x03, 0x93 ^ 0x03 };
+	command_parser_feed(&parser, save, sizeof(save), 1000 + CMD_BYTE_TIMEOUT_MS + 1);
+	CHECK_EQ(call_count, 1);
+	CHECK_EQ(calls[0].opcode, 0x93);
+	CHECK_EQ(calls[0].args[0], 0x03);
+	
+	// Within the timeout a command split across reads still completes, including across the timestamp wrapping
+	call_count = 0;
+	command_parser_feed(&parser, save, 2, 65500);
+	command_parser_feed(&parser, &save[2], 2, (uint16_t)(65500 + CMD_BYTE_TIMEOUT_MS));
+	CHECK_EQ(call_count, 1);
+	
+	// Without the sync byte, a stray opcode and argument do nothing
+	call_count = 0;
+	command_parser_feed(&parser, &save[1], 3, 2000);
+	static const char start[] = { 0x01, 0x01 };
+	command_parser_feed(&parser, start, sizeof(start), 2000);
+	CHECK_EQ(call_count, 0);
+}
+
+static command_parser_t nested_parser;
+static unsigned nested_runs;
+
+static void nested_handler(const uint8_t* args)
+{
+	nested_runs++;
+	// Feeding the parser from a handler must start a fresh command, not extend the one that just finished
+	if (args[0] == 1)
+	{
+		static const char again[] = { CMD_SYNC, 0x42, 0x02, 0x42 ^ 0x02 };
+		command_parser_feed(&nested_parser, again, sizeof(again), 0);
+	}
+}
+
+static void test_nested_feed(void)
+{
+	static const command_t nested_table[] = { { 0x42, 1, nested_handler } };
+	command_parser_init(&nested_parser, nested_table, 1);
+	static const char data[] = { CMD_SYNC, 0x42, 0x01, 0x42 ^ 0x01 };
+	command_parser_feed(&nested_parser, data, sizeof(data), 0);
+	CHECK_EQ(nested_runs, 2);
+	CHECK(nested_parser.pending == NULL);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned seed = test_seed(argc, argv);
+	
+	test_nested_feed();
+	test_timeout();
+	for (unsigned run = 0; run < 2000; run++)
+	{
+		fuzz_once();
+	}
+	test_damage();
+	return test_report("test_command", seed);
+}
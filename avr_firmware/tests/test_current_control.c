@@ -0,0 +1,136 @@
+/*
+ * test_current_control.c
+ *
+ * Created: 2026-10-17
+ *
+ * Closes the PI current loop around a simple motor model, where the IPROPI reading follows the duty of the previous tick.
+ * Checks a setpoint step settles without a lasting error, that the output clamps at both ends, and that the integrator
+ * doesn't wind up while clamped so the loop comes straight back once the load lets go.
+ */
+
+#include "current_control.h"
+#include "motor.h"
+#include "test.h"
+
+// IPROPI counts per duty step of the model motor, so full duty reads 765
+#define PLANT_GAIN 3
+
+static uint16_t plant(uint8_t duty)
+{
+	return (uint16_t)duty * PLANT_GAIN;
+}
+
+// Runs the loop for a number of ticks starting from a duty, and returns the final duty
+static uint8_t run_loop(motor motor_num, uint8_t duty, unsigned ticks)
+{
+	for (unsigned n = 0; n < ticks; n++)
+	{
+		duty = update_current_control(motor_num, plant(duty));
+	}
+	return duty;
+}
+
+static void test_arguments(void)
+{
+	CHECK(set_current_setpoint(MOTOR_COUNT, 0) != 0);
+	CHECK(set_current_setpoint(MOTOR_PINKY, CURRENT_SETPOINT_MAX + 1) != 0);
+	CHECK_EQ(set_current_setpoint(MOTOR_PINKY, CURRENT_SETPOINT_MAX), 0);
+	CHECK_EQ(update_current_control(MOTOR_COUNT, 0), 0);
+}
+
+static void test_step(void)
+{
+	for (uint16_t setpoint = 30; setpoint <= 750; setpoint += 60)
+	{
+		reset_current_control(MOTOR_INDEX);
+		CHECK_EQ(set_current_setpoint(MOTOR_INDEX, setpoint), 0);
+		uint8_t duty = 0;
+		uint8_t peak = 0;
+		for (unsigned n = 0; n < 300; n++)
+		{
+			duty = update_current_control(MOTOR_INDEX, plant(duty));
+			if (duty > peak) peak = duty;
+		}
+		// The integrator removes the steady state error, down to the resolution of the model. Every setpoint here is a multiple
+		// of PLANT_GAIN, so the duty settles on one value.
+		int error = (int)setpoint - (int)plant(duty);
+		CHECK(error >= -PLANT_GAIN && error <= PLANT_GAIN);
+		// And it gets there without a big overshoot
+		CHECK(plant(peak) <= setpoint + setpoint / 8 + PLANT_GAIN);
+		// Staying there once settled
+		CHECK_EQ(run_loop(MOTOR_INDEX, duty, 50), duty);
+	}
+}
+
+static void test_saturation(void)
+{
+	// A stalled motor that never draws any current, asked for full scale
+	reset_current_control(MOTOR_RING);
+	set_current_setpoint(MOTOR_RING, CURRENT_SETPOINT_MAX);
+	for (unsigned n = 0; n < 2000; n++)
+	{
+		CHECK_EQ(update_current_control(MOTOR_RING, 0), UINT8_MAX);
+	}
+	// Once the load lets go and the current is on target, the output comes straight down instead of staying pinned
+	// while a wound up integrator unwinds
+	set_current_setpoint(MOTOR_RING, 300);
+	uint8_t duty = update_current_control(MOTOR_RING, 300);
+	CHECK(duty < 16);
+	duty = run_loop(MOTOR_RING, duty, 300);
+	int error = 300 - (int)plant(duty);
+	CHECK(error >= -PLANT_GAIN && error <= PLANT_GAIN);
+
+	// The other way: the motor draws more than asked, e.g. while being back driven, so the output clamps at 0
+	reset_current_control(MOTOR_MIDDLE);
+	set_current_setpoint(MOTOR_MIDDLE, 0);
+	for (unsigned n = 0; n < 2000; n++)
+	{
+		CHECK_EQ(update_current_control(MOTOR_MIDDLE, CURRENT_SETPOINT_MAX), 0);
+	}
+	// Asking for current again gets the proportional response on the first tick, with nothing to unwind first
+	set_current_setpoint(MOTOR_MIDDLE, 400);
+	CHECK_EQ(update_current_control(MOTOR_MIDDLE, 0), (400 * CURRENT_KP + 400 * CURRENT_KI) >> CURRENT_FRAC_BITS);
+}
+
+static void test_integrator_clamp(void)
+{
+	// A small error the motor can never close. The proportional term alone doesn't saturate, so it integrates up to the clamp.
+	reset_current_control(MOTOR_THUMB);
+	set_current_setpoint(MOTOR_THUMB, CURRENT_SETPOINT_MAX);
+	for (unsigned n = 0; n < 5000; n++)
+	{
+		update_current_control(MOTOR_THUMB, CURRENT_SETPOINT_MAX - 10);
+	}
+	// The integrator alone holds the output near full duty
+	CHECK(update_current_control(MOTOR_THUMB, CURRENT_SETPOINT_MAX) >= UINT8_MAX - 4);
+	// But it stopped there instead of carrying on for 5000 ticks, so a small overshoot leaves the clamp on the very next tick
+	CHECK(update_current_control(MOTOR_THUMB, CURRENT_SETPOINT_MAX + 8) < UINT8_MAX);
+}
+
+static void test_reset(void)
+{
+	reset_current_control(MOTOR_PINKY);
+	// A setpoint the model can hit exactly, so the duty settles on one value
+	set_current_setpoint(MOTOR_PINKY, 501);
+	uint8_t duty = run_loop(MOTOR_PINKY, 0, 300);
+	CHECK(duty > 100);
+	// The other motors' integrators are separate
+	reset_current_control(MOTOR_INDEX);
+	CHECK_EQ(update_current_control(MOTOR_PINKY, plant(duty)), duty);
+	// With the integrator cleared there is nothing left to hold the output up with no error
+	reset_current_control(MOTOR_PINKY);
+	CHECK_EQ(update_current_control(MOTOR_PINKY, 501), 0);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned seed = test_seed(argc, argv);
+
+	test_arguments();
+	test_step();
+	test_saturation();
+	test_integrator_clamp();
+	test_reset();
+
+	return test_report("test_current_control", seed);
+}
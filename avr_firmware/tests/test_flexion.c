@@ -0,0 +1,192 @@
+/*
+ * test_flexion.c
+ *
+ * Created: 2026-10-17
+ *
+ * Drives the velocity detector with made-up finger positions, where the change over the window is chosen scan by scan.
+ * Checks the start and stop thresholds either side of the hysteresis band, that noise inside the deadband never
+ * registers as movement, and that each finger is tracked on its own.
+ */
+
+#include "flexion.h"
+#include "motor.h"
+#include "test.h"
+
+// Thresholds in kinematic units per window, the same way flexion.c scales them
+#define STOP (FLEXION_DEFAULT_DEADBAND << FLEXION_UNIT_SHIFT)
+#define START ((FLEXION_DEFAULT_DEADBAND + FLEXION_DEFAULT_HYSTERESIS) << FLEXION_UNIT_SHIFT)
+
+// Every position fed so far, so the next one can be picked to give an exact velocity over the window
+#define MAX_SCANS 4096
+static int16_t positions[MOTOR_COUNT][MAX_SCANS];
+static unsigned scans;
+static flexion_t results[MOTOR_COUNT];
+
+static void restart(void)
+{
+	reset_flexion();
+	CHECK_EQ(set_flexion_thresholds(FLEXION_DEFAULT_DEADBAND, FLEXION_DEFAULT_HYSTERESIS), 0);
+	scans = 0;
+}
+
+static void feed(const int16_t* flexion)
+{
+	finger_pose_t poses[MOTOR_COUNT] = { 0 };
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		poses[i].flexion = flexion[i];
+		positions[i][scans] = flexion[i];
+	}
+	scans++;
+	update_flexion(poses, results);
+}
+
+// Feeds one scan where each finger has moved velocity[i] since FLEXION_WINDOW scans ago
+static void feed_velocity(const int16_t* velocity)
+{
+	int16_t flexion[MOTOR_COUNT];
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		flexion[i] = positions[i][scans - FLEXION_WINDOW] + velocity[i];
+	}
+	feed(flexion);
+}
+
+// Holds every finger at 1000 for a full window, which leaves them all still
+static void prime(void)
+{
+	int16_t flexion[MOTOR_COUNT] = { 1000, 1000, 1000, 1000, 1000 };
+	for (unsigned n = 0; n < FLEXION_WINDOW; n++)
+	{
+		feed(flexion);
+	}
+}
+
+// Feeds a scan with one finger moving at a velocity and the others held, then returns that finger's direction
+static int8_t step_one(motor finger, int16_t velocity)
+{
+	int16_t velocities[MOTOR_COUNT] = { 0 };
+	velocities[finger] = velocity;
+	feed_velocity(velocities);
+	return results[finger].direction;
+}
+
+static void test_thresholds(void)
+{
+	CHECK(set_flexion_thresholds(0, 0) != 0);
+	CHECK(set_flexion_thresholds(200, 56) != 0);
+	CHECK_EQ(set_flexion_thresholds(255, 0), 0);
+	CHECK_EQ(set_flexion_thresholds(0, 1), 0);
+}
+
+static void test_priming(void)
+{
+	restart();
+	// Until the window has filled there is nothing to measure the velocity against, however far the finger jumps
+	for (unsigned n = 0; n < FLEXION_WINDOW; n++)
+	{
+		int16_t flexion[MOTOR_COUNT] = { (int16_t)(n * 500), 0, 0, 0, 0 };
+		feed(flexion);
+		CHECK_EQ(results[0].direction, 0);
+		CHECK_EQ(results[0].speed, 0);
+	}
+	CHECK_EQ(step_one(0, START), 1);
+}
+
+static void test_hysteresis(int8_t sign)
+{
+	for (motor finger = 0; finger < MOTOR_COUNT; finger++)
+	{
+		restart();
+		prime();
+
+		// A still finger has to reach the start threshold
+		CHECK_EQ(step_one(finger, sign * (START - 1)), 0);
+		CHECK_EQ(step_one(finger, sign * START), sign);
+		// Once moving it carries on down to the stop threshold
+		CHECK_EQ(step_one(finger, sign * (START - 1)), sign);
+		CHECK_EQ(step_one(finger, sign * STOP), sign);
+		CHECK_EQ(results[finger].speed, STOP >> FLEXION_UNIT_SHIFT);
+		CHECK_EQ(step_one(finger, sign * (STOP - 1)), 0);
+		// And then needs the start threshold again
+		CHECK_EQ(step_one(finger, sign * (START - 1)), 0);
+		CHECK_EQ(step_one(finger, sign * START), sign);
+
+		// Reversing hard enough switches straight over without stopping in between
+		CHECK_EQ(step_one(finger, -sign * START), -sign);
+
+		// The other fingers never moved
+		for (motor other = 0; other < MOTOR_COUNT; other++)
+		{
+			if (other != finger)
+			{
+				CHECK_EQ(results[other].direction, 0);
+				CHECK_EQ(results[other].speed, 0);
+			}
+		}
+	}
+}
+
+static void test_speed(void)
+{
+	restart();
+	prime();
+	step_one(0, 37 << FLEXION_UNIT_SHIFT);
+	CHECK_EQ(results[0].speed, 37);
+	step_one(0, -(37 << FLEXION_UNIT_SHIFT));
+	CHECK_EQ(results[0].speed, 37);
+	// Saturates rather than wrapping
+	step_one(0, 300 << FLEXION_UNIT_SHIFT);
+	CHECK_EQ(results[0].speed, UINT8_MAX);
+	CHECK_EQ(results[0].direction, 1);
+}
+
+// Jitter of every finger around a fixed point, never more than the start threshold over a window, never counts as movement
+static void test_noise(void)
+{
+	restart();
+	prime();
+	for (unsigned n = 0; n < 2000; n++)
+	{
+		int16_t flexion[MOTOR_COUNT];
+		for (motor i = 0; i < MOTOR_COUNT; i++)
+		{
+			// Positions within +-(START - 1) / 2 of the centre are at most START - 1 apart
+			flexion[i] = 1000 + (int16_t)(rand() % START) - (START - 1) / 2;
+		}
+		feed(flexion);
+		for (motor i = 0; i < MOTOR_COUNT; i++)
+		{
+			CHECK_EQ(results[i].direction, 0);
+		}
+	}
+}
+
+// A moving finger whose velocity wobbles inside the hysteresis band keeps moving
+static void test_noise_while_moving(void)
+{
+	restart();
+	prime();
+	CHECK_EQ(step_one(2, START), 1);
+	for (unsigned n = 0; n < 2000; n++)
+	{
+		int16_t velocity = STOP + (int16_t)(rand() % (START - STOP + 1));
+		CHECK_EQ(step_one(2, velocity), 1);
+	}
+	CHECK_EQ(step_one(2, STOP - 1), 0);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned seed = test_seed(argc, argv);
+
+	test_thresholds();
+	test_priming();
+	test_hysteresis(1);
+	test_hysteresis(-1);
+	test_speed();
+	test_noise();
+	test_noise_while_moving();
+
+	return test_report("test_flexion", seed);
+}
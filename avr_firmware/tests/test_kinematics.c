@@ -0,0 +1,165 @@
+/*
+ * test_kinematics.c
+ *
+ * Created: 2026-10-17
+ *
+ * Compares update_kinematics() with the same finger model worked out in doubles with the C library's sin and cos.
+ * Checks straight fingers, sweeps one joint across every quadrant of the Q15 sine table with the others fully bent,
+ * and random hands, and that bending any joint further never reduces the flexion.
+ */
+
+#include <math.h>
+
+#include "kinematics.h"
+#include "motor.h"
+#include "spi.h"
+#include "test.h"
+
+// Full scale of a calibrated angle, as update_kinematics() gets it
+#define ANGLE_MAX (CAL_ANGLE_MAX << POT_FILTER_SHIFT)
+
+// Fingertip error allowed against the reference, in KIN_LENGTH_FRAC_BITS units. Rounding to the nearest table step is
+// up to 0.35 degrees, which moves the tip of the longest finger about 0.6 mm.
+#define TIP_TOLERANCE (1 << KIN_LENGTH_FRAC_BITS)
+
+typedef struct
+{
+	potentiometer pot;
+	double rom_degrees;
+	double length_mm;
+} ref_joint_t;
+
+typedef struct
+{
+	ref_joint_t joints[3];
+	uint8_t joint_count;
+} ref_finger_t;
+
+// The geometry in kinematics.c
+static const ref_finger_t fingers[MOTOR_COUNT] =
+{
+	[MOTOR_PINKY] = { { { POT_PINKY_1, 90, 33 }, { POT_PINKY_2, 100, 18 }, { POT_PINKY_3, 80, 17 } }, 3 },
+	[MOTOR_RING] = { { { POT_RING_1, 90, 42 }, { POT_RING_2, 100, 26 }, { POT_RING_3, 80, 19 } }, 3 },
+	[MOTOR_MIDDLE] = { { { POT_MIDDLE_1, 90, 45 }, { POT_MIDDLE_2, 100, 27 }, { POT_MIDDLE_3, 80, 20 } }, 3 },
+	[MOTOR_INDEX] = { { { POT_INDEX_1, 90, 40 }, { POT_INDEX_2, 100, 23 }, { POT_INDEX_3, 80, 18 } }, 3 },
+	[MOTOR_THUMB] = { { { POT_THUMB_1, 60, 31 }, { POT_THUMB_2, 80, 26 } }, 2 },
+};
+
+// Checks every finger of a pose against the reference
+static void check_pose(const joint_angles_t* angles)
+{
+	finger_pose_t poses[MOTOR_COUNT];
+	update_kinematics(angles, poses);
+
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		const ref_finger_t* finger = &fingers[i];
+		double theta = 0;
+		double x = 0;
+		double y = 0;
+		for (uint8_t k = 0; k < finger->joint_count; k++)
+		{
+			const ref_joint_t* joint = &finger->joints[k];
+			theta += angles->joints[joint->pot] * joint->rom_degrees / 360 * KIN_TURN / ANGLE_MAX;
+			double radians = theta * 2 * M_PI / KIN_TURN;
+			x += joint->length_mm * cos(radians);
+			y += joint->length_mm * sin(radians);
+		}
+		x *= 1 << KIN_LENGTH_FRAC_BITS;
+		y *= 1 << KIN_LENGTH_FRAC_BITS;
+
+		// Each joint's share is truncated, so the flexion is never over and at most about a unit per joint under
+		CHECK(poses[i].flexion <= theta);
+		CHECK(poses[i].flexion > theta - finger->joint_count - 1);
+		CHECK(fabs(poses[i].tip_x - x) <= TIP_TOLERANCE);
+		CHECK(fabs(poses[i].tip_y - y) <= TIP_TOLERANCE);
+	}
+}
+
+static void test_straight(void)
+{
+	joint_angles_t angles = { { 0 } };
+	finger_pose_t poses[MOTOR_COUNT];
+	update_kinematics(&angles, poses);
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		double length = 0;
+		for (uint8_t k = 0; k < fingers[i].joint_count; k++)
+		{
+			length += fingers[i].joints[k].length_mm;
+		}
+		CHECK_EQ(poses[i].flexion, 0);
+		CHECK_EQ(poses[i].tip_y, 0);
+		// cos 0 is stored as 32767, just under one, so the truncated length can come out a unit short
+		int16_t tip_x = (int16_t)(length * (1 << KIN_LENGTH_FRAC_BITS));
+		CHECK(poses[i].tip_x == tip_x || poses[i].tip_x == tip_x - 1);
+	}
+}
+
+// Sweeps the first joint of every finger through its whole range with the rest fully bent, which takes the outer
+// phalanges through the second and third quadrants of the table
+static void test_sweep(void)
+{
+	for (int16_t angle = 0; angle <= ANGLE_MAX; angle++)
+	{
+		joint_angles_t angles;
+		for (uint8_t pot = 0; pot < POT_COUNT; pot++)
+		{
+			angles.joints[pot] = ANGLE_MAX;
+		}
+		for (motor i = 0; i < MOTOR_COUNT; i++)
+		{
+			angles.joints[fingers[i].joints[0].pot] = angle;
+		}
+		check_pose(&angles);
+	}
+}
+
+static void test_random(void)
+{
+	for (unsigned n = 0; n < 20000; n++)
+	{
+		joint_angles_t angles;
+		for (uint8_t pot = 0; pot < POT_COUNT; pot++)
+		{
+			angles.joints[pot] = (int16_t)(rand() % (ANGLE_MAX + 1));
+		}
+		check_pose(&angles);
+	}
+}
+
+static void test_monotonic(void)
+{
+	for (unsigned n = 0; n < 2000; n++)
+	{
+		joint_angles_t angles;
+		for (uint8_t pot = 0; pot < POT_COUNT; pot++)
+		{
+			angles.joints[pot] = (int16_t)(rand() % (ANGLE_MAX + 1));
+		}
+		finger_pose_t before[MOTOR_COUNT];
+		update_kinematics(&angles, before);
+
+		uint8_t pot = (uint8_t)(rand() % POT_COUNT);
+		angles.joints[pot] += (int16_t)(rand() % (ANGLE_MAX - angles.joints[pot] + 1));
+		finger_pose_t after[MOTOR_COUNT];
+		update_kinematics(&angles, after);
+
+		for (motor i = 0; i < MOTOR_COUNT; i++)
+		{
+			CHECK(after[i].flexion >= before[i].flexion);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned seed = test_seed(argc, argv);
+
+	test_straight();
+	test_sweep();
+	test_random();
+	test_monotonic();
+
+	return test_report("test_kinematics", seed);
+}
@@ -0,0 +1,278 @@
+/*
+ * test_repetition.c
+ *
+ * Created: 2026-10-17
+ *
+ * Moves made-up fingers through reps one scan at a time, 10 ms apart, and checks what comes out of the rep queue.
+ * Covers the REP_MIN_ROM threshold and the return fraction either side of their edges, the start following the finger
+ * down, durations and resisted time including saturation and timestamp wraparound, and a full queue.
+ */
+
+#include "repetition.h"
+#include "motor.h"
+#include "test.h"
+
+#define SCAN_MS 10
+
+// Where every finger is, so a scan can move just one of them
+static int16_t flexion[MOTOR_COUNT];
+static uint16_t now_ms;
+
+static void scan(uint8_t resisted_mask)
+{
+	finger_pose_t poses[MOTOR_COUNT] = { 0 };
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		poses[i].flexion = flexion[i];
+	}
+	now_ms += SCAN_MS;
+	update_repetitions(poses, resisted_mask, now_ms);
+}
+
+static void move(motor finger, int16_t to)
+{
+	flexion[finger] = to;
+	scan(0);
+}
+
+// Resets and primes with every finger resting at 1000
+static void restart(void)
+{
+	reset_repetitions();
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		flexion[i] = 1000;
+	}
+	scan(0);
+}
+
+static unsigned queued(void)
+{
+	unsigned count = 0;
+	rep_summary_t rep;
+	while (peek_repetition(&rep))
+	{
+		pop_repetition();
+		count++;
+	}
+	return count;
+}
+
+// Moves a finger up to a peak and back to where it started, a scan at a time in steps
+static void flex(motor finger, int16_t peak, int16_t step)
+{
+	int16_t start = flexion[finger];
+	while (flexion[finger] < peak)
+	{
+		move(finger, flexion[finger] + step > peak ? peak : flexion[finger] + step);
+	}
+	while (flexion[finger] > start)
+	{
+		move(finger, flexion[finger] - step < start ? start : flexion[finger] - step);
+	}
+}
+
+static void test_priming(void)
+{
+	reset_repetitions();
+	rep_summary_t rep;
+	CHECK(!peek_repetition(&rep));
+	// The first scan after a reset only sets where each finger rests, however flexed it is
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		flexion[i] = 5000;
+	}
+	scan(0);
+	// So coming down from there isn't the end of a rep
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		move(i, 1000);
+	}
+	CHECK_EQ(queued(), 0);
+	// Popping an empty queue does nothing
+	pop_repetition();
+	CHECK(!peek_repetition(&rep));
+}
+
+static void test_min_rom(void)
+{
+	for (motor finger = 0; finger < MOTOR_COUNT; finger++)
+	{
+		restart();
+		flex(finger, 1000 + REP_MIN_ROM - 1, 50);
+		CHECK_EQ(queued(), 0);
+
+		flex(finger, 1000 + REP_MIN_ROM, 50);
+		rep_summary_t rep;
+		CHECK(peek_repetition(&rep));
+		CHECK_EQ(rep.finger, finger);
+		CHECK_EQ(rep.number, 1);
+		CHECK_EQ(rep.rom, REP_MIN_ROM);
+		CHECK_EQ(rep.peak, 1000 + REP_MIN_ROM);
+		// Peeking leaves it queued
+		CHECK_EQ(queued(), 1);
+	}
+}
+
+static void test_return(void)
+{
+	restart();
+	move(MOTOR_INDEX, 3000);
+	// 2000 above the start, so the rep completes at 500 above it
+	move(MOTOR_INDEX, 1000 + (2000 >> REP_RETURN_SHIFT) + 1);
+	CHECK_EQ(queued(), 0);
+	// Flexing again from partway down carries on the same rep with a new peak
+	move(MOTOR_INDEX, 3400);
+	move(MOTOR_INDEX, 1000 + (2400 >> REP_RETURN_SHIFT) + 1);
+	CHECK_EQ(queued(), 0);
+	move(MOTOR_INDEX, 1000 + (2400 >> REP_RETURN_SHIFT));
+	rep_summary_t rep;
+	CHECK(peek_repetition(&rep));
+	CHECK_EQ(rep.rom, 2400);
+	CHECK_EQ(rep.peak, 3400);
+	pop_repetition();
+
+	// The next rep is measured from where the last one ended, and from lower down if the finger carries on extending
+	move(MOTOR_INDEX, 400);
+	move(MOTOR_INDEX, 200);
+	move(MOTOR_INDEX, 200 + REP_MIN_ROM);
+	move(MOTOR_INDEX, 200);
+	CHECK(peek_repetition(&rep));
+	CHECK_EQ(rep.rom, REP_MIN_ROM);
+	CHECK_EQ(rep.number, 2);
+	CHECK_EQ(queued(), 1);
+}
+
+static void test_duration(void)
+{
+	restart();
+	// Resting, with the motor driven, doesn't count towards the next rep
+	for (unsigned n = 0; n < 50; n++)
+	{
+		flexion[MOTOR_RING] = 1000 + (int16_t)(n & 1) * (REP_MIN_ROM >> REP_RETURN_SHIFT);
+		scan(1<<MOTOR_RING);
+	}
+	// 20 scans up in steps of 100, with another motor driven, and 20 down with this one driven too. The first scan up is
+	// still within the resting band, so the clock starts from there.
+	for (unsigned n = 1; n <= 20; n++)
+	{
+		flexion[MOTOR_RING] = 1000 + (int16_t)(n * 100);
+		scan(1<<MOTOR_PINKY);
+	}
+	for (unsigned n = 1; n <= 20; n++)
+	{
+		flexion[MOTOR_RING] = 3000 - (int16_t)(n * 100);
+		scan((1<<MOTOR_RING) | (1<<MOTOR_PINKY));
+	}
+	rep_summary_t rep;
+	CHECK(peek_repetition(&rep));
+	// It completes 500 above the start, 15 scans into the way down
+	CHECK_EQ(rep.duration_ms, (19 + 15) * SCAN_MS);
+	CHECK_EQ(rep.resisted_ms, 15 * SCAN_MS);
+	CHECK_EQ(queued(), 1);
+}
+
+static void test_saturation(void)
+{
+	restart();
+	// A rep held for over a minute, across the 16 bit timestamps wrapping, saturates instead of wrapping
+	move(MOTOR_THUMB, 3000);
+	for (unsigned n = 0; n < 7000; n++)
+	{
+		scan(1<<MOTOR_THUMB);
+	}
+	move(MOTOR_THUMB, 1000);
+	rep_summary_t rep;
+	CHECK(peek_repetition(&rep));
+	CHECK_EQ(rep.duration_ms, UINT16_MAX);
+	CHECK_EQ(rep.resisted_ms, UINT16_MAX);
+	pop_repetition();
+
+	// And the next one starts from zero again
+	flex(MOTOR_THUMB, 3000, 200);
+	CHECK(peek_repetition(&rep));
+	CHECK_EQ(rep.duration_ms, 18 * SCAN_MS);
+	CHECK_EQ(rep.number, 2);
+	CHECK_EQ(queued(), 1);
+}
+
+static void test_queue_full(void)
+{
+	restart();
+	for (unsigned n = 0; n < REP_QUEUE_LEN + 3; n++)
+	{
+		flex((motor)(n % MOTOR_COUNT), 3000, 500);
+	}
+	// The oldest reps stay queued, the ones after that are dropped
+	for (unsigned n = 0; n < REP_QUEUE_LEN; n++)
+	{
+		rep_summary_t rep;
+		CHECK(peek_repetition(&rep));
+		CHECK_EQ(rep.finger, n % MOTOR_COUNT);
+		CHECK_EQ(rep.number, n / MOTOR_COUNT + 1);
+		pop_repetition();
+	}
+	CHECK_EQ(queued(), 0);
+
+	// But the dropped reps still counted
+	flex(MOTOR_PINKY, 3000, 500);
+	flex(MOTOR_INDEX, 3000, 500);
+	rep_summary_t rep;
+	CHECK(peek_repetition(&rep));
+	CHECK_EQ(rep.finger, MOTOR_PINKY);
+	CHECK_EQ(rep.number, 4);
+	pop_repetition();
+	CHECK(peek_repetition(&rep));
+	CHECK_EQ(rep.finger, MOTOR_INDEX);
+	CHECK_EQ(rep.number, 3);
+
+	// A reset empties the queue and starts counting again
+	restart();
+	CHECK(!peek_repetition(&rep));
+	flex(MOTOR_INDEX, 3000, 500);
+	CHECK(peek_repetition(&rep));
+	CHECK_EQ(rep.number, 1);
+	CHECK_EQ(queued(), 1);
+}
+
+// Random motion of every finger, checking each rep as it's queued against where its finger is
+static void test_random(void)
+{
+	restart();
+	for (unsigned n = 0; n < 20000; n++)
+	{
+		for (motor i = 0; i < MOTOR_COUNT; i++)
+		{
+			int16_t to = flexion[i] + (int16_t)(rand() % 401) - 200;
+			flexion[i] = to < 0 ? 0 : to > KIN_TURN / 2 ? KIN_TURN / 2 : to;
+		}
+		scan((uint8_t)rand());
+
+		rep_summary_t rep;
+		while (peek_repetition(&rep))
+		{
+			CHECK(rep.finger < MOTOR_COUNT);
+			CHECK(rep.rom >= REP_MIN_ROM);
+			CHECK(rep.peak - rep.rom >= 0);
+			// Completes only once the finger is back down to a quarter of the range
+			CHECK(flexion[rep.finger] - (rep.peak - rep.rom) <= rep.rom >> REP_RETURN_SHIFT);
+			CHECK(rep.resisted_ms <= rep.duration_ms);
+			pop_repetition();
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned seed = test_seed(argc, argv);
+
+	test_priming();
+	test_min_rom();
+	test_return();
+	test_duration();
+	test_saturation();
+	test_queue_full();
+	test_random();
+
+	return test_report("test_repetition", seed);
+}
@@ -0,0 +1,285 @@
+/*
+ * test_resistance_curve.c
+ *
+ * Created: 2026-10-17
+ *
+ * Uploads curves point by point and checks what apply_staged_curve() accepts, then compares evaluation of random curves
+ * with exact linear interpolation. Saves them to the simulated EEPROM and checks they load back, and that a blank
+ * EEPROM or any corrupted byte of the record leaves every motor without a curve instead of with a wrong one.
+ */
+
+#include <string.h>
+
+#include "resistance_curve.h"
+#include "current_control.h"
+#include "motor.h"
+#include "hal.h"
+#include "test.h"
+
+// The simulated EEPROM, see EEMEM in hal_host.h
+extern uint8_t __start_eeprom[];
+extern uint8_t __stop_eeprom[];
+
+static curve_point_t curves[MOTOR_COUNT][RES_CURVE_MAX_POINTS];
+static uint8_t counts[MOTOR_COUNT];
+
+// Stages count points for a motor and applies them
+static int upload(motor motor_num, const curve_point_t *points, uint8_t count)
+{
+	for (uint8_t k = 0; k < count; k++)
+	{
+		CHECK_EQ(stage_curve_point(motor_num, k, &points[k]), 0);
+	}
+	return apply_staged_curve(motor_num, count);
+}
+
+// Returns the current at a flexion, or -1 without a curve
+static int evaluate(motor motor_num, int16_t flexion)
+{
+	uint16_t current = 0xBEEF;
+	if (evaluate_resistance_curve(motor_num, flexion, &current) != 0)
+	{
+		// Left alone
+		CHECK_EQ(current, 0xBEEF);
+		return -1;
+	}
+	return current;
+}
+
+// Uploads a random valid curve for every motor, keeping a copy in curves[]
+static void random_curves(void)
+{
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		counts[i] = (uint8_t)(1 + rand() % RES_CURVE_MAX_POINTS);
+		// At most 7 gaps of under 1900 + RES_CURVE_MIN_STEP after a start under 2000 stays within the turn
+		int16_t flexion = (int16_t)(rand() % 2000);
+		for (uint8_t k = 0; k < counts[i]; k++)
+		{
+			curves[i][k].flexion = flexion;
+			curves[i][k].current = (uint16_t)(rand() % (CURRENT_SETPOINT_MAX + 1));
+			flexion += RES_CURVE_MIN_STEP + rand() % 1900;
+		}
+		CHECK_EQ(upload(i, curves[i], counts[i]), 0);
+	}
+}
+
+// Checks every motor's curve at every flexion against the copy in curves[]
+static void check_curves(void)
+{
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		const curve_point_t *points = curves[i];
+		uint8_t count = counts[i];
+		for (int32_t flexion = -KIN_TURN; flexion < 2 * KIN_TURN; flexion++)
+		{
+			int current = evaluate(i, (int16_t)flexion);
+			if (flexion <= points[0].flexion)
+			{
+				CHECK_EQ(current, points[0].current);
+				continue;
+			}
+			if (flexion >= points[count - 1].flexion)
+			{
+				CHECK_EQ(current, points[count - 1].current);
+				continue;
+			}
+
+			uint8_t k = 1;
+			while (flexion > points[k].flexion)
+			{
+				k++;
+			}
+			const curve_point_t *from = &points[k - 1];
+			const curve_point_t *to = &points[k];
+			int run = to->flexion - from->flexion;
+			double exact = from->current + ((double)to->current - from->current) * (flexion - from->flexion) / run;
+			// The slope is kept to 11 fractional bits, so the error grows along a long segment, but never past its ends
+			CHECK(current - exact <= 1 + run / 2048.0 && exact - current <= 1 + run / 2048.0);
+			CHECK(current >= (from->current < to->current ? from->current : to->current));
+			CHECK(current <= (from->current > to->current ? from->current : to->current));
+			if (flexion == to->flexion)
+			{
+				CHECK_EQ(current, to->current);
+			}
+		}
+	}
+}
+
+static void check_no_curves(void)
+{
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		CHECK_EQ(evaluate(i, 0), -1);
+		CHECK_EQ(evaluate(i, KIN_TURN / 4), -1);
+	}
+}
+
+static void test_blank(void)
+{
+	// The simulated EEPROM starts out zeroed, and a real blank one reads all ones. Neither is a valid record.
+	check_no_curves();
+	CHECK(load_resistance_curves() != 0);
+	check_no_curves();
+	memset(__start_eeprom, 0xFF, (size_t)(__stop_eeprom - __start_eeprom));
+	CHECK(load_resistance_curves() != 0);
+	check_no_curves();
+}
+
+static void test_upload(void)
+{
+	curve_point_t points[RES_CURVE_MAX_POINTS];
+	for (uint8_t k = 0; k < RES_CURVE_MAX_POINTS; k++)
+	{
+		points[k].flexion = (int16_t)(k * RES_CURVE_MIN_STEP * 4);
+		points[k].current = (uint16_t)(k * 100);
+	}
+
+	CHECK(stage_curve_point(MOTOR_COUNT, 0, &points[0]) != 0);
+	CHECK(stage_curve_point(MOTOR_RING, RES_CURVE_MAX_POINTS, &points[0]) != 0);
+	CHECK(apply_staged_curve(MOTOR_COUNT, 1) != 0);
+	CHECK(apply_staged_curve(MOTOR_RING, RES_CURVE_MAX_POINTS + 1) != 0);
+
+	// Every point up to the count has to be staged
+	CHECK_EQ(stage_curve_point(MOTOR_RING, 0, &points[0]), 0);
+	CHECK_EQ(stage_curve_point(MOTOR_RING, 2, &points[2]), 0);
+	CHECK(apply_staged_curve(MOTOR_RING, 3) != 0);
+	CHECK_EQ(evaluate(MOTOR_RING, 0), -1);
+	CHECK_EQ(stage_curve_point(MOTOR_RING, 1, &points[1]), 0);
+	// And staged for the same motor
+	CHECK(apply_staged_curve(MOTOR_MIDDLE, 3) != 0);
+	CHECK_EQ(apply_staged_curve(MOTOR_RING, 3), 0);
+	CHECK_EQ(evaluate(MOTOR_RING, points[1].flexion), points[1].current);
+	// Fewer than were staged is fine
+	CHECK_EQ(apply_staged_curve(MOTOR_RING, 2), 0);
+	CHECK_EQ(evaluate(MOTOR_RING, points[2].flexion), points[1].current);
+
+	// Staging for another motor starts over
+	CHECK_EQ(stage_curve_point(MOTOR_RING, 0, &points[0]), 0);
+	CHECK_EQ(stage_curve_point(MOTOR_MIDDLE, 1, &points[1]), 0);
+	CHECK(apply_staged_curve(MOTOR_MIDDLE, 2) != 0);
+	CHECK_EQ(stage_curve_point(MOTOR_MIDDLE, 0, &points[0]), 0);
+	CHECK(apply_staged_curve(MOTOR_RING, 2) != 0);
+	CHECK_EQ(apply_staged_curve(MOTOR_MIDDLE, 2), 0);
+
+	// A full curve
+	CHECK_EQ(upload(MOTOR_INDEX, points, RES_CURVE_MAX_POINTS), 0);
+	CHECK_EQ(evaluate(MOTOR_INDEX, points[RES_CURVE_MAX_POINTS - 1].flexion), points[RES_CURVE_MAX_POINTS - 1].current);
+
+	// Rejected curves leave the old one in place
+	curve_point_t bad[2] = { { 1000, 0 }, { 1000 + RES_CURVE_MIN_STEP - 1, 100 } };
+	CHECK(upload(MOTOR_INDEX, bad, 2) != 0);
+	bad[1].flexion = 1000 - RES_CURVE_MIN_STEP;
+	CHECK(upload(MOTOR_INDEX, bad, 2) != 0);
+	bad[1].flexion = 1000 + RES_CURVE_MIN_STEP;
+	bad[1].current = CURRENT_SETPOINT_MAX + 1;
+	CHECK(upload(MOTOR_INDEX, bad, 2) != 0);
+	bad[1].current = CURRENT_SETPOINT_MAX;
+	bad[0].flexion = -1;
+	CHECK(upload(MOTOR_INDEX, bad, 2) != 0);
+	bad[0].flexion = KIN_TURN - 1 - RES_CURVE_MIN_STEP;
+	bad[1].flexion = KIN_TURN;
+	CHECK(upload(MOTOR_INDEX, bad, 2) != 0);
+	CHECK_EQ(evaluate(MOTOR_INDEX, points[1].flexion), points[1].current);
+
+	// The edges of all of those are fine, including the steepest slope there is
+	bad[1].flexion = KIN_TURN - 1;
+	CHECK_EQ(upload(MOTOR_INDEX, bad, 2), 0);
+	CHECK_EQ(evaluate(MOTOR_INDEX, KIN_TURN - 1), CURRENT_SETPOINT_MAX);
+	CHECK_EQ(evaluate(MOTOR_INDEX, KIN_TURN - 1 - RES_CURVE_MIN_STEP / 2), CURRENT_SETPOINT_MAX / 2);
+
+	// A count of 0 removes the curve
+	CHECK_EQ(apply_staged_curve(MOTOR_INDEX, 0), 0);
+	CHECK_EQ(evaluate(MOTOR_INDEX, 0), -1);
+}
+
+static void test_interpolation(void)
+{
+	for (unsigned n = 0; n < 20; n++)
+	{
+		random_curves();
+		check_curves();
+	}
+
+	// Long shallow segments, where a slope rounded away from zero would carry on past the end of the segment
+	for (unsigned n = 0; n < 20; n++)
+	{
+		for (motor i = 0; i < MOTOR_COUNT; i++)
+		{
+			counts[i] = 2;
+			curves[i][0].flexion = (int16_t)(rand() % 100);
+			curves[i][1].flexion = (int16_t)(KIN_TURN - 1 - rand() % 100);
+			curves[i][0].current = (uint16_t)(rand() % 16);
+			curves[i][1].current = (uint16_t)(rand() % 16);
+			CHECK_EQ(upload(i, curves[i], 2), 0);
+		}
+		check_curves();
+	}
+}
+
+static void test_save_load(void)
+{
+	random_curves();
+	save_resistance_curves();
+	for (motor i = 0; i < MOTOR_COUNT; i++)
+	{
+		CHECK_EQ(apply_staged_curve(i, 0), 0);
+	}
+	CHECK_EQ(load_resistance_curves(), 0);
+	check_curves();
+
+	// A motor without a curve is saved that way
+	CHECK_EQ(apply_staged_curve(MOTOR_PINKY, 0), 0);
+	save_resistance_curves();
+	CHECK_EQ(load_resistance_curves(), 0);
+	CHECK_EQ(evaluate(MOTOR_PINKY, 0), -1);
+	CHECK(evaluate(MOTOR_THUMB, 0) >= 0);
+}
+
+// Flips each bit of the stored record in turn. Either the record no longer loads and every curve is gone, or the bit
+// was padding and the curves are just as they were.
+static void test_corruption(void)
+{
+	random_curves();
+	save_resistance_curves();
+	size_t size = (size_t)(__stop_eeprom - __start_eeprom);
+	unsigned rejected = 0;
+	for (size_t byte = 0; byte < size; byte++)
+	{
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			__start_eeprom[byte] ^= (uint8_t)(1 << bit);
+			if (load_resistance_curves() != 0)
+			{
+				check_no_curves();
+				rejected++;
+			}
+			else
+			{
+				for (motor i = 0; i < MOTOR_COUNT; i++)
+				{
+					CHECK_EQ(evaluate(i, curves[i][0].flexion), curves[i][0].current);
+					CHECK_EQ(evaluate(i, curves[i][counts[i] - 1].flexion), curves[i][counts[i] - 1].current);
+				}
+			}
+			__start_eeprom[byte] ^= (uint8_t)(1 << bit);
+		}
+	}
+	// Only the padding after the version byte, which the CRC doesn't cover, gets through
+	CHECK(rejected >= (size - 1) * 8);
+	CHECK_EQ(load_resistance_curves(), 0);
+	check_curves();
+}
+
+int main(int argc, char** argv)
+{
+	unsigned seed = test_seed(argc, argv);
+
+	test_blank();
+	test_upload();
+	test_interpolation();
+	test_save_load();
+	test_corruption();
+
+	return test_report("test_resistance_curve", seed);
+}
@@ -0,0 +1,307 @@
+/*
+ * test_telemetry.c
+ *
+ * Created: 2026-10-17
+ *
+ * Sends scans through bt_send_telemetry(), captures the bytes USART0 puts on the wire, and checks that the reference decoder
+ * gets every scan back bit exactly, in both modes, across keyframes, deltas too big for a nibble, and lost frames.
+ */ 
+
+#include <string.h>
+
+#include "hal.h"
+#include "uart.h"
+#include "circular_buffer.h"
+#include "telemetry_decoder.h"
+#include "test.h"
+
+void USART0_UDRE_vect(void);
+
+#define WIRE_SIZE 256
+
+static uint8_t wire[WIRE_SIZE];
+static size_t wire_len;
+
+static void capture(uint8_t link, uint8_t data)
+{
+	if (link != UART_LINK_BT) return;
+	if (wire_len == WIRE_SIZE)
+	{
+		CHECK(!"more bytes sent than a frame holds");
+		return;
+	}
+	wire[wire_len++] = data;
+}
+
+// Runs the transmit interrupt until the send buffer is empty, the way the UART would drain it
+static void drain(void)
+{
+	while (bt_get_send_free() < BUF_SIZE)
+	{
+		USART0_UDRE_vect();
+	}
+}
+
+static uint16_t scan[TELEMETRY_CHANNELS];
+
+// Loads the 10 bit channel values into a filter output, with random bits below them that the frames drop
+static void make_readings(adc_readings_t* readings)
+{
+	for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+	{
+		int16_t filtered = (int16_t)((scan[i] << POT_FILTER_SHIFT) | (rand() & ((1 << POT_FILTER_SHIFT) - 1)));
+		if (i < POT_COUNT) readings->potentiometers[i] = filtered;
+		else readings->motors[i - POT_COUNT] = filtered;
+	}
+}
+
+static telemetry_decoder_t decoder;
+
+typedef struct
+{
+	unsigned snapshots;
+	unsigned deltas;
+	unsigned skipped;
+} frame_counts_t;
+
+// Sends the current scan and decodes what came out. Returns the frame type, or 0 if nothing was sent.
+// If lose is set, the frame is thrown away instead of decoded, as if the radio had dropped it.
+static uint8_t send_scan(frame_counts_t* counts, bool lose)
+{
+	adc_readings_t readings;
+	make_readings(&readings);
+	wire_len = 0;
+	int result = bt_send_telemetry(&readings);
+	drain();
+	
+	if (result != 0)
+	{
+		CHECK_EQ(wire_len, 0);
+		return 0;
+	}
+	CHECK(wire_len > 0);
+	int len = telemetry_frame_len(wire, wire_len);
+	CHECK_EQ(len, wire_len);
+	if (len != (int)wire_len || lose) return wire[0];
+	
+	telemetry_result decoded = telemetry_decode_frame(&decoder, wire, wire_len);
+	if (wire[0] == TELEMETRY_SNAPSHOT_TYPE)
+	{
+		counts->snapshots++;
+		CHECK_EQ(decoded, TELEMETRY_VALUES);
+	}
+	else
+	{
+		counts->deltas++;
+		CHECK(decoded != TELEMETRY_BAD_FRAME);
+	}
+	if (decoded == TELEMETRY_SKIPPED)
+	{
+		counts->skipped++;
+	}
+	else
+	{
+		CHECK(memcmp(decoder.values, scan, sizeof(scan)) == 0);
+	}
+	return wire[0];
+}
+
+static void random_scan(void)
+{
+	for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+	{
+		scan[i] = (uint16_t)(rand() & 0x3FF);
+	}
+}
+
+// Moves each channel by a random step from min_step to max_step, staying within 10 bits
+static void drift_scan(int min_step, int max_step)
+{
+	for (uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+	{
+		int value = scan[i] + min_step + rand() % (max_step - min_step + 1);
+		scan[i] = (uint16_t)(value < 0 ? 0 : value > 0x3FF ? 0x3FF : value);
+	}
+}
+
+static void restart(bool compressed)
+{
+	bt_set_compressed_telemetry(compressed);
+	telemetry_decoder_init(&decoder);
+}
+
+static void test_constants(void)
+{
+	CHECK_EQ(TELEMETRY_CHANNELS, POT_COUNT + MOTOR_COUNT);
+	CHECK_EQ(TELEMETRY_SNAPSHOT_LEN, BT_SNAPSHOT_FRAME_LEN);
+	CHECK_EQ(TELEMETRY_DELTA_HEADER_LEN + (TELEMETRY_CHANNELS + 1) / 2 + 1, BT_DELTA_MAX_FRAME_LEN);
+}
+
+static void test_uncompressed_random(void)
+{
+	frame_counts_t counts = { 0 };
+	restart(false);
+	for (unsigned i = 0; i < 500; i++)
+	{
+		random_scan();
+		CHECK_EQ(send_scan(&counts, false), TELEMETRY_SNAPSHOT_TYPE);
+	}
+	CHECK_EQ(counts.snapshots, 500);
+	CHECK_EQ(decoder.lost_frames, 0);
+}
+
+// Every step fits in a nibble, so the only snapshots are the first frame and the keyframes
+static void test_slow_drift(void)
+{
+	frame_counts_t counts = { 0 };
+	restart(true);
+	random_scan();
+	for (unsigned i = 0; i < 20 * BT_KEYFRAME_INTERVAL; i++)
+	{
+		uint8_t type = send_scan(&counts, false);
+		CHECK_EQ(type, (i % BT_KEYFRAME_INTERVAL) == 0 ? TELEMETRY_SNAPSHOT_TYPE : TELEMETRY_DELTA_TYPE);
+		// Unchanged scans and every possible delta, including both ends of the range
+		if (i % 5 != 0) drift_scan(BT_DELTA_MIN, BT_DELTA_MAX);
+	}
+	CHECK_EQ(counts.snapshots, 20);
+	CHECK_EQ(counts.skipped, 0);
+	CHECK_EQ(decoder.lost_frames, 0);
+}
+
+// Any channel moving just past what a nibble holds forces a snapshot, which also restarts the keyframe count
+static void test_large_deltas(void)
+{
+	frame_counts_t counts = { 0 };
+	restart(true);
+	random_scan();
+	uint16_t sent[TELEMETRY_CHANNELS];
+	unsigned since_keyframe = 0;
+	for (unsigned i = 0; i < 2000; i++)
+	{
+		memcpy(sent, scan, sizeof(sent));
+		drift_scan(-3, 3);
+		bool jump = rand() % 8 == 0;
+		if (jump)
+		{
+			// Measured from the value last sent, starting right at the edge of the range
+			uint8_t ch = (uint8_t)(rand() % TELEMETRY_CHANNELS);
+			int step = rand() % 2 ? BT_DELTA_MAX + 1 + rand() % 100 : BT_DELTA_MIN - 1 - rand() % 100;
+			int value = sent[ch] + step;
+			// Reflect off the ends so the change stays out of range
+			if (value < 0 || value > 0x3FF) value = sent[ch] - step;
+			scan[ch] = (uint16_t)value;
+		}
+		uint8_t type = send_scan(&counts, false);
+		bool keyframe_due = i == 0 || since_keyframe == BT_KEYFRAME_INTERVAL;
+		CHECK_EQ(type, (jump || keyframe_due) ? TELEMETRY_SNAPSHOT_TYPE : TELEMETRY_DELTA_TYPE);
+		since_keyframe = type == TELEMETRY_SNAPSHOT_TYPE ? 1 : since_keyframe + 1;
+	}
+	CHECK_EQ(counts.skipped, 0);
+	CHECK_EQ(decoder.lost_frames, 0);
+}
+
+// A frame lost on the way leaves a gap in the sequence numbers. The decoder must skip deltas until the next keyframe
+// rather than apply them to the wrong reference, then pick up exactly.
+static void test_lost_frame(void)
+{
+	frame_counts_t counts = { 0 };
+	restart(true);
+	random_scan();
+	unsigned lost_at = 10;
+	for (unsigned i = 0; i < 3 * BT_KEYFRAME_INTERVAL; i++)
+	{
+		uint8_t type = send_scan(&counts, i == lost_at);
+		if (i > lost_at && i < BT_KEYFRAME_INTERVAL)
+		{
+			CHECK_EQ(type, TELEMETRY_DELTA_TYPE);
+			CHECK(!decoder.synced);
+		}
+		if (i == BT_KEYFRAME_INTERVAL)
+		{
+			CHECK_EQ(type, TELEMETRY_SNAPSHOT_TYPE);
+			CHECK(decoder.synced);
+		}
+		drift_scan(-4, 4);
+	}
+	CHECK_EQ(counts.skipped, BT_KEYFRAME_INTERVAL - lost_at - 1);
+	CHECK_EQ(decoder.lost_frames, 1);
+}
+
+// A frame the firmware couldn't queue was never numbered, so the decoder carries on without a gap
+static void test_full_buffer(void)
+{
+	frame_counts_t counts = { 0 };
+	restart(true);
+	random_scan();
+	send_scan(&counts, false);
+	
+	// Fill the send buffer with frames that aren't drained
+	adc_readings_t readings;
+	for (unsigned i = 0; i < 10; i++)
+	{
+		drift_scan(-4, 4);
+		make_readings(&readings);
+		bt_send_telemetry(&readings);
+	}
+	drift_scan(-4, 4);
+	make_readings(&readings);
+	CHECK(bt_send_telemetry(&readings) != 0);
+	
+	// Decode everything that did go out
+	wire_len = 0;
+	drain();
+	size_t pos = 0;
+	while (pos < wire_len)
+	{
+		int len = telemetry_frame_len(&wire[pos], wire_len - pos);
+		CHECK(len > 0);
+		if (len <= 0) break;
+		CHECK_EQ(telemetry_decode_frame(&decoder, &wire[pos], (size_t)len), TELEMETRY_VALUES);
+		pos += (size_t)len;
+	}
+	
+	for (unsigned i = 0; i < 10; i++)
+	{
+		drift_scan(-4, 4);
+		send_scan(&counts, false);
+	}
+	CHECK_EQ(counts.skipped, 0);
+	CHECK_EQ(decoder.lost_frames, 0);
+}
+
+// A corrupted byte fails the checksum and changes nothing
+static void test_corrupt_frame(void)
+{
+	frame_counts_t counts = { 0 };
+	restart(true);
+	random_scan();
+	send_scan(&counts, false);
+	telemetry_decoder_t before = decoder;
+	
+	drift_scan(-4, 4);
+	adc_readings_t readings;
+	make_readings(&readings);
+	wire_len = 0;
+	bt_send_telemetry(&readings);
+	drain();
+	wire[wire_len - 2] ^= 0x10;
+	CHECK_EQ(telemetry_decode_frame(&decoder, wire, wire_len), TELEMETRY_BAD_FRAME);
+	CHECK(memcmp(&decoder, &before, sizeof(decoder)) == 0);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned seed = test_seed(argc, argv);
+	
+	setup_uart();
+	hal_host_set_uart_sink(capture);
+	
+	test_constants();
+	test_uncompressed_random();
+	test_slow_drift();
+	test_large_deltas();
+	test_lost_frame();
+	test_full_buffer();
+	test_corrupt_frame();
+	return test_report("test_telemetry", seed);
+}